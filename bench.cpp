@@ -0,0 +1,385 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "cbfframe.h"
+#include "byteoffset.h"
+#include "compression.h"
+#include "md5.h"
+
+// Synthetic detector frame: name, dimensions and pixels
+struct BenchFrame {
+    std::string name;
+    int width;
+    int height;
+    std::vector<int32_t> pixels;
+};
+
+// Timing of one operation on one frame
+struct BenchResult {
+    std::string frame;
+    std::string op;
+    size_t pixels;
+    size_t bytes;           // Bytes processed per call (pixel data, or compressed data for md5)
+    int iterations;
+    double medianUs;
+    double minUs;
+};
+
+// Detector-like sizes from a PILATUS 100K module to an EIGER 16M
+struct FrameSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+static const FrameSize FRAME_SIZES[] = {
+    {"100k", 487, 195},
+    {"1m", 981, 1043},
+    {"6m", 2463, 2527},
+    {"16m", 4150, 4371}
+};
+
+// Poisson background rising towards the beam centre, Gaussian Bragg peaks
+// (some too bright for 16 bits), hot pixels, -1 module gaps and -2 dead pixels
+static BenchFrame generateFrame(const FrameSize& size, unsigned seed) {
+    BenchFrame frame;
+    frame.name = size.name;
+    frame.width = size.width;
+    frame.height = size.height;
+    frame.pixels.resize(static_cast<size_t>(size.width) * static_cast<size_t>(size.height));
+
+    std::mt19937 rng(seed);
+    const int LEVELS = 16;
+    std::vector<std::poisson_distribution<int> > background;
+    for (int level = 0; level < LEVELS; ++level) {
+        background.push_back(std::poisson_distribution<int>(0.2 + 3.0 * level / (LEVELS - 1)));
+    }
+
+    double cx = size.width / 2.0, cy = size.height / 2.0;
+    double maxRadius = std::sqrt(cx * cx + cy * cy);
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            double radius = std::sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy)) / maxRadius;
+            int level = std::min(LEVELS - 1, static_cast<int>((1.0 - radius) * LEVELS));
+            frame.pixels[static_cast<size_t>(y) * size.width + x] = background[level](rng);
+        }
+    }
+
+    // Bragg peaks with log-uniform intensity
+    size_t count = frame.pixels.size();
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t peak = 0; peak < count / 2000; ++peak) {
+        double px = unit(rng) * size.width, py = unit(rng) * size.height;
+        double sigma = 0.7 + 1.3 * unit(rng);
+        double intensity = std::pow(10.0, 1.0 + 5.0 * unit(rng));
+        int reach = static_cast<int>(std::ceil(3 * sigma));
+        for (int y = std::max(0, static_cast<int>(py) - reach); y <= std::min(size.height - 1, static_cast<int>(py) + reach); ++y) {
+            for (int x = std::max(0, static_cast<int>(px) - reach); x <= std::min(size.width - 1, static_cast<int>(px) + reach); ++x) {
+                double d2 = (x - px) * (x - px) + (y - py) * (y - py);
+                frame.pixels[static_cast<size_t>(y) * size.width + x] += static_cast<int32_t>(intensity * std::exp(-d2 / (2 * sigma * sigma)));
+            }
+        }
+    }
+
+    std::uniform_int_distribution<size_t> anywhere(0, count - 1);
+    for (size_t i = 0; i < count / 50000 + 1; ++i) {
+        frame.pixels[anywhere(rng)] = 1048500;
+    }
+    for (size_t i = 0; i < count / 20000 + 1; ++i) {
+        frame.pixels[anywhere(rng)] = -2;
+    }
+
+    // PILATUS module gaps: 487x195 pixel modules, 7 and 17 pixels apart
+    for (int y = 0; y < size.height; ++y) {
+        for (int x = 0; x < size.width; ++x) {
+            if (x % 494 >= 487 || y % 212 >= 195) {
+                frame.pixels[static_cast<size_t>(y) * size.width + x] = -1;
+            }
+        }
+    }
+    return frame;
+}
+
+// Call fn until minSeconds have passed (at least 3 times); returns the time
+// of every call in microseconds
+template <typename Fn>
+static std::vector<double> timeCalls(double minSeconds, Fn fn) {
+    std::vector<double> times;
+    double total = 0;
+    while (times.size() < 3 || total < minSeconds * 1e6) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto stop = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+        total += times.back();
+    }
+    return times;
+}
+
+static BenchResult summarize(const BenchFrame& frame, const std::string& op, size_t bytes, std::vector<double> times) {
+    std::sort(times.begin(), times.end());
+    BenchResult result;
+    result.frame = frame.name;
+    result.op = op;
+    result.pixels = frame.pixels.size();
+    result.bytes = bytes;
+    result.iterations = static_cast<int>(times.size());
+    result.medianUs = times[times.size() / 2];
+    result.minUs = times.front();
+    return result;
+}
+
+static double megabytesPerSecond(const BenchResult& result) {
+    return result.bytes / result.medianUs;
+}
+
+static double framesPerSecond(const BenchResult& result) {
+    return 1e6 / result.medianUs;
+}
+
+// Run every operation on frame; the CBF file goes to path
+static bool benchFrame(const BenchFrame& frame, const std::string& path, double minSeconds, std::vector<BenchResult>& results) {
+    size_t count = frame.pixels.size();
+    size_t rawBytes = count * sizeof(int32_t);
+    size_t first = results.size();
+
+    std::vector<uint8_t> compressed(nanocbf::byteOffsetMaxSize(count));
+    size_t compressedSize = 0;
+    results.push_back(summarize(frame, "compress", rawBytes, timeCalls(minSeconds, [&]() {
+        compressedSize = nanocbf::encodeByteOffset(frame.pixels.data(), count, compressed.data());
+    })));
+
+    std::vector<int32_t> decoded(count);
+    results.push_back(summarize(frame, "decompress", rawBytes, timeCalls(minSeconds, [&]() {
+        nanocbf::ByteOffsetState state;
+        nanocbf::decodeByteOffset(compressed.data(), compressedSize, state, decoded.data(), count);
+    })));
+    if (decoded != frame.pixels) {
+        std::cerr << frame.name << ": byte offset roundtrip mismatch" << std::endl;
+        return false;
+    }
+
+    // The pre-scan of the threaded decoder, then the decoder on 2 to 8 threads
+    results.push_back(summarize(frame, "index", compressedSize, timeCalls(minSeconds, [&]() {
+        nanocbf::indexByteOffset(compressed.data(), compressedSize, count, 65536);
+    })));
+    for (unsigned threads = 2; threads <= 8; threads *= 2) {
+        std::fill(decoded.begin(), decoded.end(), 0);
+        results.push_back(summarize(frame, "decompress_t" + std::to_string(threads), rawBytes, timeCalls(minSeconds, [&]() {
+            nanocbf::decodeByteOffsetParallel(compressed.data(), compressedSize, decoded.data(), count, threads);
+        })));
+        if (decoded != frame.pixels) {
+            std::cerr << frame.name << ": threaded byte offset roundtrip mismatch" << std::endl;
+            return false;
+        }
+    }
+
+    results.push_back(summarize(frame, "md5", compressedSize, timeCalls(minSeconds, [&]() {
+        nanocbf::MD5State md5;
+        nanocbf::md5Update(md5, compressed.data(), compressedSize);
+        uint8_t digest[16];
+        nanocbf::md5Final(md5, digest);
+    })));
+
+    std::vector<uint8_t> packed(nanocbf::packedMaxSize(count));
+    size_t packedSize = 0;
+    results.push_back(summarize(frame, "packed_compress", rawBytes, timeCalls(minSeconds, [&]() {
+        packedSize = nanocbf::encodePacked(frame.pixels.data(), count, static_cast<size_t>(frame.width), false, packed.data());
+    })));
+    results.push_back(summarize(frame, "packed_decompress", rawBytes, timeCalls(minSeconds, [&]() {
+        nanocbf::decodePacked(packed.data(), packedSize, decoded.data(), count, static_cast<size_t>(frame.width), false);
+    })));
+    if (decoded != frame.pixels) {
+        std::cerr << frame.name << ": packed roundtrip mismatch" << std::endl;
+        return false;
+    }
+
+    nanocbf::CBFFrame cbf;
+    cbf.width = frame.width;
+    cbf.height = frame.height;
+    cbf.data = frame.pixels;
+    bool written = true;
+    results.push_back(summarize(frame, "write", rawBytes, timeCalls(minSeconds, [&]() {
+        written = cbf.write(path) && written;
+    })));
+    if (!written) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    nanocbf::CBFFrame readBack;
+    bool read = true;
+    results.push_back(summarize(frame, "read", rawBytes, timeCalls(minSeconds, [&]() {
+        read = readBack.read(path) && read;
+    })));
+    if (!read || readBack.data != frame.pixels) {
+        std::cerr << path << ": " << (read ? "read back different pixels" : readBack.getError()) << std::endl;
+        return false;
+    }
+    results.push_back(summarize(frame, "readHeader", rawBytes, timeCalls(minSeconds, [&]() {
+        readBack.readHeader(path);
+    })));
+
+    std::cout << frame.name << " (" << frame.width << "x" << frame.height << ", "
+              << compressedSize << " bytes byte offset, " << packedSize << " bytes packed)" << std::endl;
+    for (size_t i = first; i < results.size(); ++i) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "  %-18s %10.1f MB/s %10.1f frames/s", results[i].op.c_str(),
+                      megabytesPerSecond(results[i]), framesPerSecond(results[i]));
+        std::cout << line << std::endl;
+    }
+    return true;
+}
+
+// Time read and readHeader on an existing file
+static bool benchFile(const std::string& filename, double minSeconds, std::vector<BenchResult>& results) {
+    nanocbf::CBFFrame cbf;
+    if (!cbf.read(filename)) {
+        std::cerr << "Failed to read " << filename << ": " << cbf.getError() << std::endl;
+        return false;
+    }
+
+    BenchFrame frame;
+    frame.name = filename;
+    frame.width = cbf.width;
+    frame.height = cbf.height;
+    frame.pixels.swap(cbf.data);
+    size_t rawBytes = frame.pixels.size() * sizeof(int32_t);
+    results.push_back(summarize(frame, "read", rawBytes, timeCalls(minSeconds, [&]() { cbf.read(filename); })));
+    results.push_back(summarize(frame, "readHeader", rawBytes, timeCalls(minSeconds, [&]() { cbf.readHeader(filename); })));
+
+    std::cout << filename << " (" << frame.width << "x" << frame.height << ")" << std::endl;
+    std::cout << "  read:       " << results[results.size() - 2].medianUs << " us/call" << std::endl;
+    std::cout << "  readHeader: " << results.back().medianUs << " us/call" << std::endl;
+    return true;
+}
+
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, unsigned seed, double minSeconds) {
+    out << "{\n"
+        << "  \"kernel\": " << jsonString(nanocbf::byteOffsetKernelName()) << ",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"seed\": " << seed << ",\n"
+        << "  \"min_time_s\": " << minSeconds << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"frame\": " << jsonString(r.frame) << ", \"op\": " << jsonString(r.op)
+            << ", \"pixels\": " << r.pixels << ", \"bytes\": " << r.bytes << ", \"iterations\": " << r.iterations
+            << ", \"median_us\": " << r.medianUs << ", \"min_us\": " << r.minUs
+            << ", \"mb_per_s\": " << megabytesPerSecond(r) << ", \"frames_per_s\": " << framesPerSecond(r) << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static void usage() {
+    std::cerr << "Usage: nanocbf_bench [options] [file.cbf ...]\n"
+              << "  --sizes LIST     Synthetic frame sizes, any of 100k,1m,6m,16m (default all)\n"
+              << "  --min-time SEC   Minimum time spent per operation (default 0.5)\n"
+              << "  --seed N         Seed of the synthetic frames (default 1)\n"
+              << "  --dir DIR        Where the benchmark files are written (default .)\n"
+              << "  --corpus         Keep the written files as a reference corpus\n"
+              << "  --json FILE      Write results as JSON to FILE (- for stdout)\n"
+              << "Files given on the command line are timed with read and readHeader." << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string sizes = "100k,1m,6m,16m";
+    double minSeconds = 0.5;
+    unsigned seed = 1;
+    std::string dir = ".";
+    bool keepFiles = false;
+    std::string jsonPath;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            sizes = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            minSeconds = std::atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--dir" && hasValue) {
+            dir = argv[++i];
+        } else if (arg == "--corpus") {
+            keepFiles = true;
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    // JSON on stdout replaces the table
+    std::streambuf* console = std::cout.rdbuf();
+    std::ostringstream discarded;
+    if (jsonPath == "-") {
+        std::cout.rdbuf(discarded.rdbuf());
+    }
+
+    std::vector<BenchResult> results;
+    bool ok = true;
+    std::stringstream list(sizes);
+    std::string name;
+    while (std::getline(list, name, ',')) {
+        const FrameSize* size = nullptr;
+        for (const FrameSize& candidate : FRAME_SIZES) {
+            if (name == candidate.name) {
+                size = &candidate;
+            }
+        }
+        if (!size) {
+            std::cerr << "Unknown frame size " << name << std::endl;
+            usage();
+            return 1;
+        }
+
+        BenchFrame frame = generateFrame(*size, seed);
+        std::string path = dir + "/nanocbf_bench_" + frame.name + ".cbf";
+        ok = benchFrame(frame, path, minSeconds, results) && ok;
+        if (!keepFiles) {
+            std::remove(path.c_str());
+        }
+    }
+    for (const std::string& file : files) {
+        ok = benchFile(file, minSeconds, results) && ok;
+    }
+
+    std::cout.rdbuf(console);
+    if (jsonPath == "-") {
+        writeJson(std::cout, results, seed, minSeconds);
+    } else if (!jsonPath.empty()) {
+        std::ofstream json(jsonPath);
+        writeJson(json, results, seed, minSeconds);
+        if (!json) {
+            std::cerr << "Could not write " << jsonPath << std::endl;
+            return 1;
+        }
+    }
+    return ok ? 0 : 1;
+}
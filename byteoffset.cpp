@@ -0,0 +1,875 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "byteoffset.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <cstring>
+
+#if !defined(NANOCBF_NO_SIMD)
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define NANOCBF_HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define NANOCBF_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__)
+#define NANOCBF_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace nanocbf {
+
+    // Pixels decoded at a time into an int32_t buffer when the output is 16-bit
+    static const size_t DECODE_TILE_PIXELS = 4096;
+
+    // Plain deltas in a row after which indexByteOffset skips ahead to the next escape
+    static const size_t INDEX_RUN_PIXELS = 16;
+
+    // Decode a single pixel at pos, updating value. Returns false if the stream
+    // ends in the middle of an escape sequence. Arithmetic is done unsigned so
+    // overflowing deltas wrap the same way the SIMD kernels do.
+    static inline bool stepByteOffset(const uint8_t* in, size_t size, size_t& pos, uint32_t& value) {
+        uint8_t delta8 = in[pos];
+        if (delta8 != 0x80) {
+            value += static_cast<uint32_t>(static_cast<int32_t>(static_cast<int8_t>(delta8)));
+            pos += 1;
+            return true;
+        }
+
+        // 16-bit or 32-bit delta
+        if (pos + 2 >= size) return false;
+        uint16_t delta16 = static_cast<uint16_t>(in[pos + 1] | (in[pos + 2] << 8));
+        if (delta16 != 0x8000) {
+            value += static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(delta16)));
+            pos += 3;
+            return true;
+        }
+
+        // 32-bit delta
+        if (pos + 6 >= size) return false;
+        uint32_t delta32 = static_cast<uint32_t>(in[pos + 3]) |
+                           (static_cast<uint32_t>(in[pos + 4]) << 8) |
+                           (static_cast<uint32_t>(in[pos + 5]) << 16) |
+                           (static_cast<uint32_t>(in[pos + 6]) << 24);
+        value += delta32;
+        pos += 7;
+        return true;
+    }
+
+    static inline int countTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(mask);
+#endif
+    }
+
+    // Decode steps pixels one at a time; used to get past an escape sequence
+    static inline bool stepsByteOffset(const uint8_t* in, size_t size, size_t& pos, uint32_t& value,
+                                       int32_t* out, size_t& decoded, int steps) {
+        for (int i = 0; i < steps; ++i) {
+            if (!stepByteOffset(in, size, pos, value)) return false;
+            out[decoded++] = static_cast<int32_t>(value);
+        }
+        return true;
+    }
+
+    size_t decodeByteOffsetScalar(const uint8_t* compressed, size_t size, ByteOffsetState& state, int32_t* out, size_t count) {
+        size_t pos = state.pos;
+        uint32_t value = static_cast<uint32_t>(state.value);
+        size_t decoded = 0;
+
+        while (pos < size && decoded < count) {
+            if (!stepByteOffset(compressed, size, pos, value)) break;
+            out[decoded++] = static_cast<int32_t>(value);
+        }
+
+        state.pos = pos;
+        state.value = static_cast<int32_t>(value);
+        return decoded;
+    }
+
+    // The SIMD kernels look at a window of bytes, decode every group of 8 plain
+    // deltas before the first escape with vector code, and then step through
+    // the escape sequence with the scalar code.
+
+#ifdef NANOCBF_HAVE_SSE2
+    // Decode 8 plain deltas at in, returning the new running value broadcast
+    static inline __m128i sse2Group8(const uint8_t* in, __m128i base, int32_t* out) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+
+        // Sign-extend to 16 bit and prefix-sum; 8 deltas of at most 128 cannot overflow
+        __m128i x = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+
+        // Widen to 32 bit and add the running value
+        __m128i a = _mm_add_epi32(base, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128i b = _mm_add_epi32(base, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), b);
+        return _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    static size_t decodeByteOffsetSSE2(const uint8_t* compressed, size_t size, ByteOffsetState& state, int32_t* out, size_t count) {
+        const __m128i escape = _mm_set1_epi8(static_cast<char>(0x80));
+        size_t pos = state.pos;
+        uint32_t value = static_cast<uint32_t>(state.value);
+        size_t decoded = 0;
+
+        while (pos + 16 <= size && decoded + 16 <= count) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(compressed + pos));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, escape)));
+            int plain = mask ? countTrailingZeros(mask) : 16;
+
+            int groups = plain / 8;
+            if (groups > 0) {
+                __m128i base = _mm_set1_epi32(static_cast<int32_t>(value));
+                for (int g = 0; g < groups; ++g) {
+                    base = sse2Group8(compressed + pos + 8 * g, base, out + decoded + 8 * g);
+                }
+                value = static_cast<uint32_t>(_mm_cvtsi128_si32(base));
+                pos += 8 * groups;
+                decoded += 8 * groups;
+            }
+
+            if (mask != 0 && !stepsByteOffset(compressed, size, pos, value, out, decoded, plain - 8 * groups + 1)) {
+                state.pos = pos;
+                state.value = static_cast<int32_t>(value);
+                return decoded;
+            }
+        }
+
+        state.pos = pos;
+        state.value = static_cast<int32_t>(value);
+        return decoded + decodeByteOffsetScalar(compressed, size, state, out + decoded, count - decoded);
+    }
+#endif
+
+#ifdef NANOCBF_HAVE_AVX2
+    __attribute__((target("avx2")))
+    static inline __m256i avx2Group8(const uint8_t* in, __m256i base, int32_t* out) {
+        // Sign-extend 8 bytes to 32 bit and prefix-sum within each 128-bit lane
+        __m256i x = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+
+        // Carry the low lane total into the high lane
+        __m256i carry = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+        x = _mm256_add_epi32(x, _mm256_permute2x128_si256(carry, carry, 0x08));
+
+        x = _mm256_add_epi32(x, base);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), x);
+        return _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+    }
+
+    __attribute__((target("avx2")))
+    static size_t decodeByteOffsetAVX2(const uint8_t* compressed, size_t size, ByteOffsetState& state, int32_t* out, size_t count) {
+        const __m256i escape = _mm256_set1_epi8(static_cast<char>(0x80));
+        size_t pos = state.pos;
+        uint32_t value = static_cast<uint32_t>(state.value);
+        size_t decoded = 0;
+
+        while (pos + 32 <= size && decoded + 32 <= count) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(compressed + pos));
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, escape)));
+            int plain = mask ? countTrailingZeros(mask) : 32;
+
+            int groups = plain / 8;
+            if (groups > 0) {
+                __m256i base = _mm256_set1_epi32(static_cast<int32_t>(value));
+                for (int g = 0; g < groups; ++g) {
+                    base = avx2Group8(compressed + pos + 8 * g, base, out + decoded + 8 * g);
+                }
+                value = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_castsi256_si128(base)));
+                pos += 8 * groups;
+                decoded += 8 * groups;
+            }
+
+            if (mask != 0 && !stepsByteOffset(compressed, size, pos, value, out, decoded, plain - 8 * groups + 1)) {
+                state.pos = pos;
+                state.value = static_cast<int32_t>(value);
+                return decoded;
+            }
+        }
+
+        state.pos = pos;
+        state.value = static_cast<int32_t>(value);
+        return decoded + decodeByteOffsetSSE2(compressed, size, state, out + decoded, count - decoded);
+    }
+#endif
+
+#ifdef NANOCBF_HAVE_NEON
+    static inline int32x4_t neonGroup8(const uint8_t* in, int32x4_t base, int32_t* out) {
+        const int32x4_t zero = vdupq_n_s32(0);
+        int16x8_t deltas = vmovl_s8(vld1_s8(reinterpret_cast<const int8_t*>(in)));
+        int32x4_t halves[2] = {vmovl_s16(vget_low_s16(deltas)), vmovl_s16(vget_high_s16(deltas))};
+
+        for (int k = 0; k < 2; ++k) {
+            int32x4_t x = halves[k];
+            x = vaddq_s32(x, vextq_s32(zero, x, 3));
+            x = vaddq_s32(x, vextq_s32(zero, x, 2));
+            x = vaddq_s32(x, base);
+            vst1q_s32(out + 4 * k, x);
+            base = vdupq_laneq_s32(x, 3);
+        }
+        return base;
+    }
+
+    static size_t decodeByteOffsetNEON(const uint8_t* compressed, size_t size, ByteOffsetState& state, int32_t* out, size_t count) {
+        const uint8x16_t escape = vdupq_n_u8(0x80);
+        size_t pos = state.pos;
+        uint32_t value = static_cast<uint32_t>(state.value);
+        size_t decoded = 0;
+
+        while (pos + 16 <= size && decoded + 16 <= count) {
+            uint8x16_t isEscape = vceqq_u8(vld1q_u8(compressed + pos), escape);
+
+            // One nibble per byte; the first set nibble is the first escape
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(isEscape), 4)), 0);
+            int plain = mask ? countTrailingZeros(mask) / 4 : 16;
+
+            int groups = plain / 8;
+            if (groups > 0) {
+                int32x4_t base = vdupq_n_s32(static_cast<int32_t>(value));
+                for (int g = 0; g < groups; ++g) {
+                    base = neonGroup8(compressed + pos + 8 * g, base, out + decoded + 8 * g);
+                }
+                value = static_cast<uint32_t>(vgetq_lane_s32(base, 0));
+                pos += 8 * groups;
+                decoded += 8 * groups;
+            }
+
+            if (mask != 0 && !stepsByteOffset(compressed, size, pos, value, out, decoded, plain - 8 * groups + 1)) {
+                state.pos = pos;
+                state.value = static_cast<int32_t>(value);
+                return decoded;
+            }
+        }
+
+        state.pos = pos;
+        state.value = static_cast<int32_t>(value);
+        return decoded + decodeByteOffsetScalar(compressed, size, state, out + decoded, count - decoded);
+    }
+#endif
+
+    // Wrapping sum of count plain one-byte deltas
+    static inline uint32_t sumPlainDeltas(const uint8_t* in, size_t count) {
+        // Each delta biased by 128 is its byte with the top bit flipped, which
+        // lets unsigned horizontal sums add them up
+        uint64_t biased = 0;
+        size_t i = 0;
+#if defined(NANOCBF_HAVE_SSE2)
+        const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sums = zero;
+        for (; i + 16 <= count; i += 16) {
+            __m128i bytes = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), flip);
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(bytes, zero));
+        }
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        biased = lanes[0] + lanes[1];
+#elif defined(NANOCBF_HAVE_NEON)
+        uint64x2_t sums = vdupq_n_u64(0);
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t bytes = veorq_u8(vld1q_u8(in + i), vdupq_n_u8(0x80));
+            sums = vpadalq_u32(sums, vpaddlq_u16(vpaddlq_u8(bytes)));
+        }
+        biased = vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+#endif
+        for (; i < count; ++i) {
+            biased += in[i] ^ 0x80u;
+        }
+        return static_cast<uint32_t>(biased - 128 * static_cast<uint64_t>(count));
+    }
+
+    std::vector<ByteOffsetState> indexByteOffset(const uint8_t* compressed, size_t size, size_t count, size_t chunkPixels) {
+        std::vector<ByteOffsetState> index;
+        index.reserve(chunkPixels > 0 ? count / chunkPixels + 1 : 1);
+
+        // Plain deltas are one byte per pixel, so in long runs of them only the
+        // escapes need to be looked at: memchr finds the next one and the run
+        // in front of it is summed with vector code. Pixels are stepped one at
+        // a time until such a run shows up, which is faster for noisy data.
+        size_t pos = 0;
+        uint32_t value = 0;
+        size_t pixel = 0;
+        size_t chunkEnd = 0;
+        size_t plainRun = 0;
+        while (pixel < count && pos < size) {
+            if (pixel == chunkEnd) {
+                ByteOffsetState state;
+                state.pos = pos;
+                state.value = static_cast<int32_t>(value);
+                index.push_back(state);
+                chunkEnd = chunkPixels > 0 ? chunkEnd + chunkPixels : count;
+            }
+
+            size_t stop = std::min(count, chunkEnd);
+            if (plainRun < INDEX_RUN_PIXELS) {
+                bool truncated = false;
+                for (; pixel < stop && pos < size && plainRun < INDEX_RUN_PIXELS; ++pixel) {
+                    plainRun = compressed[pos] != 0x80 ? plainRun + 1 : 0;
+                    if (!stepByteOffset(compressed, size, pos, value)) {
+                        truncated = true;
+                        break;
+                    }
+                }
+                if (truncated) break;
+                continue;
+            }
+
+            size_t limit = std::min(size - pos, stop - pixel);
+            const uint8_t* escape = static_cast<const uint8_t*>(std::memchr(compressed + pos, 0x80, limit));
+            size_t run = escape ? static_cast<size_t>(escape - (compressed + pos)) : limit;
+            value += sumPlainDeltas(compressed + pos, run);
+            pos += run;
+            pixel += run;
+            if (escape) {
+                plainRun = 0;
+            }
+        }
+        return index;
+    }
+
+    // Run decodeChunk(state, first, count) over chunks of chunkPixels pixels on
+    // up to threads threads, chunk k starting from index[k]; decodeChunk returns
+    // the number of pixels it decoded. Returns false if a chunk does not end
+    // exactly where the index says the next one starts.
+    template <typename DecodeChunk>
+    static bool decodeIndexedChunks(const std::vector<ByteOffsetState>& index, size_t count, unsigned threads,
+                                    size_t chunkPixels, DecodeChunk decodeChunk, size_t& total) {
+        std::vector<size_t> decoded(index.size(), 0);
+        std::atomic<bool> consistent(true);
+
+        // Workers take chunks in order; each starts from its indexed state
+        std::atomic<size_t> nextChunk(0);
+        auto work = [&]() {
+            for (size_t chunk = nextChunk++; chunk < index.size(); chunk = nextChunk++) {
+                size_t first = chunk * chunkPixels;
+                if (first >= count) break;
+                ByteOffsetState state = index[chunk];
+                decoded[chunk] = decodeChunk(state, first, std::min(chunkPixels, count - first));
+                if (chunk + 1 < index.size() && (state.pos != index[chunk + 1].pos || state.value != index[chunk + 1].value)) {
+                    consistent = false;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        size_t workerCount = std::min<size_t>(std::max(threads, 1u), index.size());
+        for (size_t i = 1; i < workerCount; ++i) {
+            workers.push_back(std::thread(work));
+        }
+        work();
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i].join();
+        }
+
+        // Only the last indexed chunk can be short
+        total = 0;
+        for (size_t i = 0; i < decoded.size(); ++i) {
+            total += decoded[i];
+        }
+        return consistent;
+    }
+
+    // decodeIndexedChunks with an index from a pre-scan of the stream
+    template <typename DecodeChunk>
+    static size_t decodeChunksParallel(const uint8_t* compressed, size_t size, size_t count,
+                                       unsigned threads, size_t chunkPixels, DecodeChunk decodeChunk) {
+        if (threads <= 1 || chunkPixels == 0 || count <= chunkPixels) {
+            ByteOffsetState state;
+            return decodeChunk(state, 0, count);
+        }
+
+        size_t total;
+        decodeIndexedChunks(indexByteOffset(compressed, size, count, chunkPixels), count, threads, chunkPixels, decodeChunk, total);
+        return total;
+    }
+
+    template <typename T>
+    size_t decodeByteOffsetParallel(const uint8_t* compressed, size_t size, T* out, size_t count,
+                                    unsigned threads, size_t chunkPixels) {
+        return decodeChunksParallel(compressed, size, count, threads, chunkPixels,
+            [=](ByteOffsetState& state, size_t first, size_t chunkCount) {
+                return decodeByteOffset(compressed, size, state, out + first, chunkCount);
+            });
+    }
+
+    template <typename T>
+    bool decodeByteOffsetIndexed(const uint8_t* compressed, size_t size, T* out, size_t count,
+                                 const std::vector<ByteOffsetState>& index, size_t chunkPixels, unsigned threads, size_t& decoded) {
+        if (chunkPixels == 0 || index.empty()) {
+            decoded = 0;
+            return false;
+        }
+        return decodeIndexedChunks(index, count, threads, chunkPixels,
+            [=](ByteOffsetState& state, size_t first, size_t chunkCount) {
+                return state.pos <= size ? decodeByteOffset(compressed, size, state, out + first, chunkCount) : 0;
+            }, decoded);
+    }
+
+    // Pixel as the decoder accumulates it; unsigned 32-bit values keep their bits
+    template <typename T>
+    static inline int32_t pixelValue(T pixel) {
+        return static_cast<int32_t>(pixel);
+    }
+
+    // Deltas are taken with wrapping arithmetic, matching the decoder
+    static inline int32_t pixelDelta(int32_t pixel, int32_t previous) {
+        return static_cast<int32_t>(static_cast<uint32_t>(pixel) - static_cast<uint32_t>(previous));
+    }
+
+    template <typename T>
+    size_t byteOffsetEncodedSize(const T* data, size_t count) {
+        if (count == 0) return 0;
+
+        // Branch-free so the compiler can vectorize it: 1 byte per pixel, plus 2
+        // for a 16-bit escape and 4 more for a 32-bit escape
+        size_t size = 0;
+        int32_t first = pixelValue(data[0]);
+        uint32_t magnitude = first < 0 ? 0u - static_cast<uint32_t>(first) : static_cast<uint32_t>(first);
+        size += 1 + (magnitude > 127 ? 2 : 0) + (magnitude > 32767 ? 4 : 0);
+        for (size_t i = 1; i < count; ++i) {
+            int32_t delta = pixelDelta(pixelValue(data[i]), pixelValue(data[i - 1]));
+            magnitude = delta < 0 ? 0u - static_cast<uint32_t>(delta) : static_cast<uint32_t>(delta);
+            size += 1 + (magnitude > 127 ? 2 : 0) + (magnitude > 32767 ? 4 : 0);
+        }
+        return size;
+    }
+
+    template <typename T>
+    size_t encodeByteOffset(const T* data, size_t count, uint8_t* out, int32_t previous) {
+        uint8_t* p = out;
+        int32_t currentValue = previous;
+        for (size_t i = 0; i < count; ++i) {
+            int32_t pixel = pixelValue(data[i]);
+            int32_t delta = pixelDelta(pixel, currentValue);
+            currentValue = pixel;
+
+            if (delta >= -127 && delta <= 127) {
+                // 8-bit delta
+                *p++ = static_cast<uint8_t>(delta);
+            } else if (delta >= -32767 && delta <= 32767) {
+                // 16-bit delta
+                p[0] = 0x80;
+                p[1] = static_cast<uint8_t>(delta & 0xFF);
+                p[2] = static_cast<uint8_t>((delta >> 8) & 0xFF);
+                p += 3;
+            } else {
+                // 32-bit delta
+                uint32_t value = static_cast<uint32_t>(delta);
+                p[0] = 0x80;
+                p[1] = 0x00;
+                p[2] = 0x80;
+                p[3] = static_cast<uint8_t>(value & 0xFF);
+                p[4] = static_cast<uint8_t>((value >> 8) & 0xFF);
+                p[5] = static_cast<uint8_t>((value >> 16) & 0xFF);
+                p[6] = static_cast<uint8_t>((value >> 24) & 0xFF);
+                p += 7;
+            }
+        }
+        return static_cast<size_t>(p - out);
+    }
+
+    typedef size_t (*ByteOffsetKernel)(const uint8_t*, size_t, ByteOffsetState&, int32_t*, size_t);
+
+    struct ByteOffsetKernelChoice {
+        ByteOffsetKernel decode;
+        const char* name;
+    };
+
+    static ByteOffsetKernelChoice selectByteOffsetKernel() {
+        ByteOffsetKernelChoice choice = {decodeByteOffsetScalar, "scalar"};
+#if defined(NANOCBF_HAVE_AVX2)
+        if (__builtin_cpu_supports("avx2")) {
+            choice.decode = decodeByteOffsetAVX2;
+            choice.name = "avx2";
+            return choice;
+        }
+#endif
+#if defined(NANOCBF_HAVE_SSE2)
+        choice.decode = decodeByteOffsetSSE2;
+        choice.name = "sse2";
+#elif defined(NANOCBF_HAVE_NEON)
+        choice.decode = decodeByteOffsetNEON;
+        choice.name = "neon";
+#endif
+        return choice;
+    }
+
+    static const ByteOffsetKernelChoice& byteOffsetKernel() {
+        static const ByteOffsetKernelChoice choice = selectByteOffsetKernel();
+        return choice;
+    }
+
+    // Keep the low 16 bits of each pixel, like static_cast does
+    template <typename T>
+    static void narrowPixels(const int32_t* in, T* out, size_t count) {
+        size_t i = 0;
+#if defined(NANOCBF_HAVE_SSE2)
+        for (; i + 8 <= count; i += 8) {
+            // Sign-extend the low halves so the saturating pack leaves them unchanged
+            __m128i lo = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), 16), 16);
+            __m128i hi = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)), 16), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+        }
+#elif defined(NANOCBF_HAVE_NEON)
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t narrow = vcombine_s16(vmovn_s32(vld1q_s32(in + i)), vmovn_s32(vld1q_s32(in + i + 4)));
+            vst1q_s16(reinterpret_cast<int16_t*>(out + i), narrow);
+        }
+#endif
+        for (; i < count; ++i) {
+            out[i] = static_cast<T>(in[i]);
+        }
+    }
+
+    template <typename T>
+    size_t decodeByteOffset(const uint8_t* compressed, size_t size, ByteOffsetState& state, T* out, size_t count) {
+        ByteOffsetKernel decode = byteOffsetKernel().decode;
+        if (sizeof(T) == sizeof(int32_t)) {
+            // Signed and unsigned 32-bit pixels share the same bits
+            return decode(compressed, size, state, reinterpret_cast<int32_t*>(out), count);
+        }
+
+        // Narrower pixels: decode a tile at a time, then store it at the pixel width
+        int32_t tile[DECODE_TILE_PIXELS];
+        size_t decoded = 0;
+        while (decoded < count) {
+            size_t wanted = std::min(count - decoded, DECODE_TILE_PIXELS);
+            size_t got = decode(compressed, size, state, tile, wanted);
+            narrowPixels(tile, out + decoded, got);
+            decoded += got;
+            if (got < wanted) break;
+        }
+        return decoded;
+    }
+
+    PixelCorrection PixelCorrection::from(size_t first) const {
+        PixelCorrection shifted = *this;
+        if (offset) shifted.offset += first;
+        if (gain) shifted.gain += first;
+        if (mask) shifted.mask += first;
+        return shifted;
+    }
+
+#if defined(NANOCBF_HAVE_SSE2)
+    // SSE2 only converts signed lanes; both 16-bit halves convert exactly, so
+    // the sum is rounded once, like a scalar conversion
+    static inline __m128 convertUnsigned(__m128i pixels) {
+        __m128 high = _mm_cvtepi32_ps(_mm_srli_epi32(pixels, 16));
+        __m128 low = _mm_cvtepi32_ps(_mm_and_si128(pixels, _mm_set1_epi32(0xFFFF)));
+        return _mm_add_ps(_mm_mul_ps(high, _mm_set1_ps(65536.0f)), low);
+    }
+#endif
+
+    // Convert and correct a tile of raw pixels; the flags say which arrays are
+    // present and whether the raw values are unsigned
+    template <bool HasOffset, bool HasGain, bool HasMask, bool RawUnsigned>
+    static void correctPixels(const int32_t* raw, float* out, size_t count, const PixelCorrection& c) {
+        size_t i = 0;
+        const bool maskNegativeRaw = c.maskNegative && !RawUnsigned;
+#if defined(NANOCBF_HAVE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_cmpeq_epi32(zero, zero);
+        const __m128i maskNegative = maskNegativeRaw ? ones : zero;
+        const __m128 masked = _mm_set1_ps(c.maskedValue);
+        for (; i + 4 <= count; i += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + i));
+            __m128 value = RawUnsigned ? convertUnsigned(pixels) : _mm_cvtepi32_ps(pixels);
+            if (HasOffset) value = _mm_sub_ps(value, _mm_loadu_ps(c.offset + i));
+            if (HasGain) value = _mm_mul_ps(value, _mm_loadu_ps(c.gain + i));
+
+            __m128i bad = _mm_and_si128(_mm_cmplt_epi32(pixels, zero), maskNegative);
+            if (HasMask) {
+                int32_t maskBytes;
+                std::memcpy(&maskBytes, c.mask + i, 4);
+                __m128i flags = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(maskBytes), zero), zero);
+                bad = _mm_or_si128(bad, _mm_xor_si128(_mm_cmpeq_epi32(flags, zero), ones));
+            }
+
+            __m128 badMask = _mm_castsi128_ps(bad);
+            _mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(badMask, masked), _mm_andnot_ps(badMask, value)));
+        }
+#elif defined(NANOCBF_HAVE_NEON)
+        const uint32x4_t maskNegative = vdupq_n_u32(maskNegativeRaw ? 0xFFFFFFFFu : 0u);
+        const float32x4_t masked = vdupq_n_f32(c.maskedValue);
+        for (; i + 4 <= count; i += 4) {
+            int32x4_t pixels = vld1q_s32(raw + i);
+            float32x4_t value = RawUnsigned ? vcvtq_f32_u32(vreinterpretq_u32_s32(pixels)) : vcvtq_f32_s32(pixels);
+            if (HasOffset) value = vsubq_f32(value, vld1q_f32(c.offset + i));
+            if (HasGain) value = vmulq_f32(value, vld1q_f32(c.gain + i));
+
+            uint32x4_t bad = vandq_u32(vcltq_s32(pixels, vdupq_n_s32(0)), maskNegative);
+            if (HasMask) {
+                uint32_t maskBytes;
+                std::memcpy(&maskBytes, c.mask + i, 4);
+                uint32x4_t flags = vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(maskBytes)))));
+                bad = vorrq_u32(bad, vtstq_u32(flags, flags));
+            }
+
+            vst1q_f32(out + i, vbslq_f32(bad, masked, value));
+        }
+#endif
+        for (; i < count; ++i) {
+            float value = RawUnsigned ? static_cast<float>(static_cast<uint32_t>(raw[i])) : static_cast<float>(raw[i]);
+            if (HasOffset) value -= c.offset[i];
+            if (HasGain) value *= c.gain[i];
+            bool bad = (maskNegativeRaw && raw[i] < 0) || (HasMask && c.mask[i] != 0);
+            out[i] = bad ? c.maskedValue : value;
+        }
+    }
+
+    typedef void (*CorrectPixels)(const int32_t*, float*, size_t, const PixelCorrection&);
+
+    size_t decodeByteOffsetCorrected(const uint8_t* compressed, size_t size, ByteOffsetState& state, float* out, size_t count,
+                                     const PixelCorrection& correction) {
+        static const CorrectPixels variants[16] = {
+            correctPixels<false, false, false, false>, correctPixels<false, false, false, true>,
+            correctPixels<false, false, true, false>, correctPixels<false, false, true, true>,
+            correctPixels<false, true, false, false>, correctPixels<false, true, false, true>,
+            correctPixels<false, true, true, false>, correctPixels<false, true, true, true>,
+            correctPixels<true, false, false, false>, correctPixels<true, false, false, true>,
+            correctPixels<true, false, true, false>, correctPixels<true, false, true, true>,
+            correctPixels<true, true, false, false>, correctPixels<true, true, false, true>,
+            correctPixels<true, true, true, false>, correctPixels<true, true, true, true>
+        };
+        CorrectPixels correct = variants[(correction.offset ? 8 : 0) | (correction.gain ? 4 : 0) | (correction.mask ? 2 : 0) |
+                                         (correction.rawUnsigned ? 1 : 0)];
+        ByteOffsetKernel decode = byteOffsetKernel().decode;
+
+        // Raw pixels only ever exist one cache-resident tile at a time
+        int32_t tile[DECODE_TILE_PIXELS];
+        size_t decoded = 0;
+        while (decoded < count) {
+            size_t wanted = std::min(count - decoded, DECODE_TILE_PIXELS);
+            size_t got = decode(compressed, size, state, tile, wanted);
+            correct(tile, out + decoded, got, correction.from(decoded));
+            decoded += got;
+            if (got < wanted) break;
+        }
+        return decoded;
+    }
+
+    size_t decodeByteOffsetCorrectedParallel(const uint8_t* compressed, size_t size, float* out, size_t count,
+                                             const PixelCorrection& correction, unsigned threads, size_t chunkPixels) {
+        return decodeChunksParallel(compressed, size, count, threads, chunkPixels,
+            [&](ByteOffsetState& state, size_t first, size_t chunkCount) {
+                return decodeByteOffsetCorrected(compressed, size, state, out + first, chunkCount, correction.from(first));
+            });
+    }
+
+    // Decode count pixels into tile and drop them
+    static bool skipPixels(ByteOffsetKernel decode, const uint8_t* compressed, size_t size, ByteOffsetState& state,
+                           int32_t* tile, size_t count) {
+        while (count > 0) {
+            size_t wanted = std::min(count, DECODE_TILE_PIXELS);
+            if (decode(compressed, size, state, tile, wanted) < wanted) return false;
+            count -= wanted;
+        }
+        return true;
+    }
+
+    // Add count groups of bin consecutive pixels to count bins; a bin that
+    // is or becomes negative (masked) is set to -1. Inlined, so the common
+    // constant bin sizes get their own unrolled loop.
+    static inline void addToBins(const int32_t* pixels, int32_t* bins, size_t count, size_t bin) {
+        for (size_t k = 0; k < count; ++k) {
+            // The OR of the values is negative iff any of them is
+            int32_t signs = bins[k];
+            uint32_t sum = static_cast<uint32_t>(bins[k]);
+            for (size_t i = 0; i < bin; ++i) {
+                signs |= pixels[k * bin + i];
+                sum += static_cast<uint32_t>(pixels[k * bin + i]);
+            }
+            bins[k] = signs < 0 ? -1 : static_cast<int32_t>(sum);
+        }
+    }
+
+    bool decodeByteOffsetRegion(const uint8_t* compressed, size_t size, size_t frameWidth, const DecodeRegion& region,
+                                int32_t* out, ByteOffsetState state, size_t firstRow) {
+        size_t bin = region.bin;
+        size_t outWidth = region.outputWidth();
+        size_t outHeight = region.outputHeight();
+        std::fill(out, out + outWidth * outHeight, 0);
+        if (outWidth == 0 || outHeight == 0) {
+            return true;
+        }
+
+        ByteOffsetKernel decode = byteOffsetKernel().decode;
+        int32_t tile[DECODE_TILE_PIXELS];
+
+        // Rows in front of the region still have to be scanned
+        if (!skipPixels(decode, compressed, size, state, tile, (region.y - firstRow) * frameWidth)) return false;
+
+        // Pixels after the last column of the last row are never decoded
+        size_t endRow = region.y + outHeight * bin;
+        size_t endColumn = region.x + outWidth * bin;
+        for (size_t row = region.y; row < endRow; ++row) {
+            int32_t* outRow = out + ((row - region.y) / bin) * outWidth;
+            size_t rowEnd = row + 1 == endRow ? endColumn : frameWidth;
+
+            if (bin == 1) {
+                // Decode the region's columns straight into place
+                if (!skipPixels(decode, compressed, size, state, tile, region.x) ||
+                    decode(compressed, size, state, outRow, outWidth) < outWidth ||
+                    !skipPixels(decode, compressed, size, state, tile, rowEnd - endColumn)) {
+                    return false;
+                }
+                continue;
+            }
+
+            for (size_t column = 0; column < rowEnd; ) {
+                size_t wanted = std::min(rowEnd - column, DECODE_TILE_PIXELS);
+                if (decode(compressed, size, state, tile, wanted) < wanted) return false;
+
+                // A bin cut by the tile edge is added to pixel by pixel, the
+                // whole bins in between in one go
+                size_t from = std::max(column, region.x);
+                size_t to = std::min(column + wanted, endColumn);
+                if (from < to) {
+                    int32_t* bins = outRow + (from - region.x) / bin;
+                    size_t c = from;
+                    for (; c < to && (c - region.x) % bin != 0; ++c) {
+                        addToBins(tile + (c - column), bins, 1, 1);
+                        if ((c + 1 - region.x) % bin == 0) ++bins;
+                    }
+                    size_t wholeBins = (to - c) / bin;
+                    if (bin == 2) addToBins(tile + (c - column), bins, wholeBins, 2);
+                    else if (bin == 4) addToBins(tile + (c - column), bins, wholeBins, 4);
+                    else addToBins(tile + (c - column), bins, wholeBins, bin);
+                    c += wholeBins * bin;
+                    bins += wholeBins;
+                    for (; c < to; ++c) {
+                        addToBins(tile + (c - column), bins, 1, 1);
+                    }
+                }
+                column += wanted;
+            }
+        }
+        return true;
+    }
+
+    const char* byteOffsetKernelName() {
+        return byteOffsetKernel().name;
+    }
+
+    // Decoders registered for particular frame geometries
+    struct GeometryDecoder {
+        size_t width, height;
+        ByteOffsetFrameDecoder decode;
+    };
+
+    typedef std::vector<GeometryDecoder> GeometryTable;
+
+    // Lookups read the current table without locking. Registering publishes
+    // a modified copy and keeps the old tables, which a decode on another
+    // thread may still be reading; registrations are rare, so they add up to little
+    static std::mutex g_geometryMutex;     // Serializes registrations
+    static std::vector<std::unique_ptr<const GeometryTable> > g_geometryTables;
+    static std::atomic<const GeometryTable*> g_geometryTable(nullptr);
+
+    void registerByteOffsetDecoder(size_t width, size_t height, ByteOffsetFrameDecoder decoder) {
+        std::lock_guard<std::mutex> lock(g_geometryMutex);
+        const GeometryTable* current = g_geometryTable.load(std::memory_order_relaxed);
+        std::unique_ptr<GeometryTable> table(current ? new GeometryTable(*current) : new GeometryTable());
+
+        bool found = false;
+        for (size_t i = 0; i < table->size(); ++i) {
+            if ((*table)[i].width == width && (*table)[i].height == height) {
+                if (decoder) {
+                    (*table)[i].decode = decoder;
+                } else {
+                    table->erase(table->begin() + i);
+                }
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            if (!decoder) {
+                return;
+            }
+            GeometryDecoder entry = {width, height, decoder};
+            table->push_back(entry);
+        }
+
+        g_geometryTable.store(table.get(), std::memory_order_release);
+        g_geometryTables.push_back(std::unique_ptr<const GeometryTable>(table.release()));
+    }
+
+    ByteOffsetFrameDecoder byteOffsetDecoderFor(size_t width, size_t height) {
+        const GeometryTable* table = g_geometryTable.load(std::memory_order_acquire);
+        if (!table) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < table->size(); ++i) {
+            if ((*table)[i].width == width && (*table)[i].height == height) {
+                return (*table)[i].decode;
+            }
+        }
+        return nullptr;
+    }
+
+    template size_t decodeByteOffset<int32_t>(const uint8_t*, size_t, ByteOffsetState&, int32_t*, size_t);
+    template size_t decodeByteOffset<uint32_t>(const uint8_t*, size_t, ByteOffsetState&, uint32_t*, size_t);
+    template size_t decodeByteOffset<int16_t>(const uint8_t*, size_t, ByteOffsetState&, int16_t*, size_t);
+    template size_t decodeByteOffset<uint16_t>(const uint8_t*, size_t, ByteOffsetState&, uint16_t*, size_t);
+
+    template size_t decodeByteOffsetParallel<int32_t>(const uint8_t*, size_t, int32_t*, size_t, unsigned, size_t);
+    template size_t decodeByteOffsetParallel<uint32_t>(const uint8_t*, size_t, uint32_t*, size_t, unsigned, size_t);
+    template size_t decodeByteOffsetParallel<int16_t>(const uint8_t*, size_t, int16_t*, size_t, unsigned, size_t);
+    template size_t decodeByteOffsetParallel<uint16_t>(const uint8_t*, size_t, uint16_t*, size_t, unsigned, size_t);
+
+    template bool decodeByteOffsetIndexed<int32_t>(const uint8_t*, size_t, int32_t*, size_t, const std::vector<ByteOffsetState>&, size_t, unsigned, size_t&);
+    template bool decodeByteOffsetIndexed<uint32_t>(const uint8_t*, size_t, uint32_t*, size_t, const std::vector<ByteOffsetState>&, size_t, unsigned, size_t&);
+    template bool decodeByteOffsetIndexed<int16_t>(const uint8_t*, size_t, int16_t*, size_t, const std::vector<ByteOffsetState>&, size_t, unsigned, size_t&);
+    template bool decodeByteOffsetIndexed<uint16_t>(const uint8_t*, size_t, uint16_t*, size_t, const std::vector<ByteOffsetState>&, size_t, unsigned, size_t&);
+
+    template size_t byteOffsetEncodedSize<int32_t>(const int32_t*, size_t);
+    template size_t byteOffsetEncodedSize<uint32_t>(const uint32_t*, size_t);
+    template size_t byteOffsetEncodedSize<int16_t>(const int16_t*, size_t);
+    template size_t byteOffsetEncodedSize<uint16_t>(const uint16_t*, size_t);
+
+    template size_t encodeByteOffset<int32_t>(const int32_t*, size_t, uint8_t*, int32_t);
+    template size_t encodeByteOffset<uint32_t>(const uint32_t*, size_t, uint8_t*, int32_t);
+    template size_t encodeByteOffset<int16_t>(const int16_t*, size_t, uint8_t*, int32_t);
+    template size_t encodeByteOffset<uint16_t>(const uint16_t*, size_t, uint8_t*, int32_t);
+}
@@ -0,0 +1,156 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BYTEOFFSET_H
+#define BYTEOFFSET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <limits>
+
+namespace nanocbf {
+
+// Position inside an x-CBF_BYTE_OFFSET stream, so decoding can be resumed
+struct ByteOffsetState {
+    size_t pos;      // Next byte to read in the compressed stream
+    int32_t value;   // Last decoded pixel value
+    ByteOffsetState() : pos(0), value(0) {}
+};
+
+// The function templates below are instantiated for the pixel types int32_t,
+// uint32_t, int16_t and uint16_t. Values are accumulated with wrapping 32-bit
+// arithmetic as the format requires and stored at the width of the pixel type.
+
+// Decode up to count pixels into out, starting from state and advancing it.
+// Returns the number of pixels decoded (less than count if the stream ends).
+// Uses the fastest kernel available on this CPU; all kernels give identical
+// output. 16-bit pixels are decoded through a small buffer that stays in cache.
+template <typename T>
+size_t decodeByteOffset(const uint8_t* compressed, size_t size, ByteOffsetState& state, T* out, size_t count);
+
+// Portable reference kernel
+size_t decodeByteOffsetScalar(const uint8_t* compressed, size_t size, ByteOffsetState& state, int32_t* out, size_t count);
+
+// Scan the stream without storing pixels and return the decoder state at
+// pixels 0, chunkPixels, 2 * chunkPixels, ... (up to count pixels), so each
+// chunk can be decoded independently
+std::vector<ByteOffsetState> indexByteOffset(const uint8_t* compressed, size_t size, size_t count, size_t chunkPixels);
+
+// Decode count pixels on up to threads threads: a pre-scan finds the state at
+// every chunkPixels boundary, then the chunks are decoded in parallel
+template <typename T>
+size_t decodeByteOffsetParallel(const uint8_t* compressed, size_t size, T* out, size_t count,
+                                unsigned threads, size_t chunkPixels = 65536);
+
+// Decode count pixels on up to threads threads from a stored index: chunk k
+// of chunkPixels pixels starts from index[k], like indexByteOffset returns.
+// Returns false if the chunks do not join up, i.e. the index does not match
+// the stream; decoded is then meaningless.
+template <typename T>
+bool decodeByteOffsetIndexed(const uint8_t* compressed, size_t size, T* out, size_t count,
+                             const std::vector<ByteOffsetState>& index, size_t chunkPixels, unsigned threads, size_t& decoded);
+
+// Per-pixel correction applied by the float decoders. The arrays are indexed
+// like the output; any of them may be null.
+struct PixelCorrection {
+    const float* offset;    // Subtracted from the raw value (dark or pedestal)
+    const float* gain;      // Multiplied in after the offset (flat field)
+    const uint8_t* mask;    // Non-zero marks a bad pixel
+    bool maskNegative;      // Also mask negative raw values (-1 gaps, -2 bad pixels in Pilatus files)
+    bool rawUnsigned;       // Raw values are unsigned 32-bit, so none of them is negative
+    float maskedValue;      // Written for masked pixels
+
+    PixelCorrection() : offset(nullptr), gain(nullptr), mask(nullptr), maskNegative(true), rawUnsigned(false),
+                        maskedValue(std::numeric_limits<float>::quiet_NaN()) {}
+
+    // The same correction for pixels starting at first
+    PixelCorrection from(size_t first) const;
+};
+
+// Decode up to count pixels as float with correction applied, without ever
+// storing a frame of raw integers: out = (raw - offset) * gain, or maskedValue
+size_t decodeByteOffsetCorrected(const uint8_t* compressed, size_t size, ByteOffsetState& state, float* out, size_t count,
+                                 const PixelCorrection& correction);
+
+// decodeByteOffsetCorrected on up to threads threads, like decodeByteOffsetParallel
+size_t decodeByteOffsetCorrectedParallel(const uint8_t* compressed, size_t size, float* out, size_t count,
+                                         const PixelCorrection& correction, unsigned threads, size_t chunkPixels = 65536);
+
+// Rectangle of a frame to decode, with each bin x bin block of it summed
+// into one output pixel (bin 1 decodes the region as is). Rows and columns
+// that do not fill a whole bin are dropped.
+struct DecodeRegion {
+    size_t x, y;            // First column and row
+    size_t width, height;   // Size in frame pixels
+    size_t bin;
+
+    DecodeRegion() : x(0), y(0), width(0), height(0), bin(1) {}
+    DecodeRegion(size_t x, size_t y, size_t width, size_t height, size_t bin = 1)
+        : x(x), y(y), width(width), height(height), bin(bin) {}
+
+    size_t outputWidth() const { return bin > 0 ? width / bin : 0; }
+    size_t outputHeight() const { return bin > 0 ? height / bin : 0; }
+};
+
+// Decode region of a frame with frameWidth columns into out, which must hold
+// outputWidth() * outputHeight() pixels. Only the rows up to the end of the
+// region are decoded and only its columns stored. A bin that contains a
+// negative (masked) pixel is set to -1. state is at the start of row firstRow,
+// which must not be after region.y. Returns false if the stream ends early.
+bool decodeByteOffsetRegion(const uint8_t* compressed, size_t size, size_t frameWidth, const DecodeRegion& region,
+                            int32_t* out, ByteOffsetState state = ByteOffsetState(), size_t firstRow = 0);
+
+// Worst-case compressed size: every pixel needs a 7-byte 32-bit escape
+inline size_t byteOffsetMaxSize(size_t count) { return 7 * count; }
+
+// Exact compressed size of count pixels, computed without writing anything
+template <typename T>
+size_t byteOffsetEncodedSize(const T* data, size_t count);
+
+// Compress count pixels into out, which must hold byteOffsetEncodedSize()
+// (or byteOffsetMaxSize()) bytes. Returns the number of bytes written.
+// previous is the pixel before data[0], so a frame can be compressed in chunks.
+template <typename T>
+size_t encodeByteOffset(const T* data, size_t count, uint8_t* out, int32_t previous = 0);
+
+// Name of the kernel selected by decodeByteOffset ("avx2", "sse2", "neon" or "scalar")
+const char* byteOffsetKernelName();
+
+// Decoder for a whole frame of one geometry, from the start of its stream.
+// Returns the number of pixels decoded, like decodeByteOffset.
+typedef size_t (*ByteOffsetFrameDecoder)(const uint8_t* compressed, size_t size, int32_t* out);
+
+// Use decoder for every width x height frame that CBFFrame decodes on one
+// thread from the start of the stream, e.g. a kernel tuned for a detector's
+// fixed geometry. Other frames keep decodeByteOffset. A null decoder removes
+// the entry; the decoder must give the same pixels as decodeByteOffset.
+void registerByteOffsetDecoder(size_t width, size_t height, ByteOffsetFrameDecoder decoder);
+
+// Decoder registered for width x height frames, or null for decodeByteOffset
+ByteOffsetFrameDecoder byteOffsetDecoderFor(size_t width, size_t height);
+
+} // namespace nanocbf
+
+#endif // BYTEOFFSET_H
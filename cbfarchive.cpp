@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cbfarchive.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace nanocbf {
+
+    CBFArchive::CBFArchive() : m_data(nullptr), m_size(0) {}
+
+    CBFArchive::CBFArchive(const std::string& filename) : m_data(nullptr), m_size(0) {
+        open(filename);
+    }
+
+    CBFArchive::~CBFArchive() {}
+
+    bool CBFArchive::open(const std::string& filename) {
+        close();
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if (!file->open(filename)) {
+            m_error = "Could not open file: " + filename;
+            return false;
+        }
+        m_file = std::move(file);
+        return open(m_file->data(), m_file->size());
+    }
+
+    bool CBFArchive::open(const uint8_t* image, size_t size) {
+        m_data = image;
+        m_size = size;
+        m_error.clear();
+
+        CBFFrame scanner;
+        if (!scanner.findSections(image, size, m_sections)) {
+            m_error = scanner.getError();
+            return false;
+        }
+        return true;
+    }
+
+    void CBFArchive::close() {
+        m_sections.clear();
+        m_file.reset();
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    template <typename T>
+    bool CBFArchive::readAll(std::vector<BasicCBFFrame<T> >& frames, unsigned threads) {
+        frames.resize(m_sections.size());
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, m_sections.size())));
+
+        // Sections are handed out one at a time, so uneven sizes balance out
+        std::atomic<size_t> next(0);
+        std::vector<char> failed(m_sections.size(), 0);
+        auto work = [&]() {
+            for (size_t i = next++; i < m_sections.size(); i = next++) {
+                failed[i] = !read(i, frames[i]);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.push_back(std::thread(work));
+        }
+        work();
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+
+        for (size_t i = 0; i < failed.size(); ++i) {
+            if (failed[i]) {
+                m_error = "Section " + std::to_string(i) + ": " + frames[i].getError();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template bool CBFArchive::readAll<int32_t>(std::vector<BasicCBFFrame<int32_t> >&, unsigned);
+    template bool CBFArchive::readAll<uint32_t>(std::vector<BasicCBFFrame<uint32_t> >&, unsigned);
+    template bool CBFArchive::readAll<int16_t>(std::vector<BasicCBFFrame<int16_t> >&, unsigned);
+    template bool CBFArchive::readAll<uint16_t>(std::vector<BasicCBFFrame<uint16_t> >&, unsigned);
+}
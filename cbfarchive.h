@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CBFARCHIVE_H
+#define CBFARCHIVE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include "cbfframe.h"
+
+namespace nanocbf {
+
+// A file holding several binary sections, e.g. frames written one after the
+// other to one stream with CBFFrame::write(std::ostream&). Every section is
+// indexed in one scan when the archive is opened; frames are then decoded
+// one at a time or all in parallel.
+class CBFArchive {
+public:
+    CBFArchive();
+    explicit CBFArchive(const std::string& filename);
+    ~CBFArchive();
+
+    // Map filename and index its binary sections
+    bool open(const std::string& filename);
+
+    // Index an image held in memory, which must outlive the archive
+    bool open(const uint8_t* image, size_t size);
+
+    void close();
+
+    // Number of binary sections
+    size_t size() const { return m_sections.size(); }
+    const BinarySection& section(size_t index) const { return m_sections[index]; }
+
+    // Decode section index into frame; on failure frame.getError() says why
+    template <typename T>
+    bool read(size_t index, BasicCBFFrame<T>& frame) const {
+        return index < m_sections.size() && frame.decode(m_data, m_size, m_sections[index]);
+    }
+
+    // Decode every section into frames on threads threads (0 uses one per
+    // hardware core). Returns false if any section failed; getError() names
+    // the first one.
+    template <typename T>
+    bool readAll(std::vector<BasicCBFFrame<T> >& frames, unsigned threads = 0);
+
+    const std::string& getError() const { return m_error; }
+
+private:
+    CBFArchive(const CBFArchive&);
+    CBFArchive& operator=(const CBFArchive&);
+
+    std::unique_ptr<MappedFile> m_file;
+    const uint8_t* m_data;
+    size_t m_size;
+    std::vector<BinarySection> m_sections;
+    std::string m_error;
+};
+
+} // namespace nanocbf
+
+#endif // CBFARCHIVE_H
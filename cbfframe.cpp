@@ -22,497 +22,1441 @@
  * SOFTWARE.
  */
 
-#include "CBFFrame.h"
+#include "cbfframe.h"
+#include "mappedfile.h"
+#include "byteoffset.h"
+#include "compression.h"
+#include "filewriter.h"
+#include "md5.h"
 #include <fstream>
 #include <sstream>
-#include <regex>
+#include <cctype>
 #include <iomanip>
 #include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
 
 namespace nanocbf {
     // CBF magic number and tail
-    const std::vector<uint8_t> CBFFrame::CBF_MAGIC = {0x0C, 0x1A, 0x04, 0xD5};
-    const std::string CBFFrame::CBF_TAIL = std::string(4095, '\0') + "\r\n--CIF-BINARY-FORMAT-SECTION----\r\n;\r\n\r\n";
+    const std::vector<uint8_t> CBFFrameBase::CBF_MAGIC = {0x0C, 0x1A, 0x04, 0xD5};
+    const std::string CBFFrameBase::CBF_TAIL = std::string(4095, '\0') + "\r\n--CIF-BINARY-FORMAT-SECTION----\r\n;\r\n\r\n";
+
+    // Minimal header written when header is empty
+    const std::string CBFFrameBase::DEFAULT_HEADER =
+        "_array_data.header_convention \"nanocbf empty\"\r\n"
+        "_array_data.header_contents\r\n"
+        ";\r\n"
+        ";\r\n\r\n";
+
+    // Find length bytes of pattern in [from, end); returns end if not found.
+    // memchr skips to candidates for the first byte, which is far faster than
+    // std::search on long runs without it (text, padding or compressed data).
+    static const char* findBytes(const char* from, const char* end, const char* pattern, size_t length) {
+        while (end - from >= static_cast<ptrdiff_t>(length)) {
+            const char* candidate = static_cast<const char*>(std::memchr(from, pattern[0], (end - from) - length + 1));
+            if (!candidate) {
+                break;
+            }
+            if (std::memcmp(candidate + 1, pattern + 1, length - 1) == 0) {
+                return candidate;
+            }
+            from = candidate + 1;
+        }
+        return end;
+    }
 
-    CBFFrame::CBFFrame() : width(0), height(0) {}
-    CBFFrame::CBFFrame(const std::string& filename) : width(0), height(0) {
-      read(filename);
+    // Find a text marker in [from, end); returns end if not found
+    static const char* findMarker(const char* from, const char* end, const char* marker) {
+        return findBytes(from, end, marker, std::strlen(marker));
     }
 
-    CBFFrame::~CBFFrame() {}
+    const char* CBFFrameBase::findMagic(const char* from, const char* end) {
+        return findBytes(from, end, reinterpret_cast<const char*>(CBF_MAGIC.data()), CBF_MAGIC.size());
+    }
 
-    bool CBFFrame::read(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            m_error = "Could not open file: " + filename;
-            return false;
+    const char* CBFFrameBase::findSectionEnd(const char* payloadEnd, const char* fileEnd, size_t padding) {
+        // Written as subtractions, so a huge padding value cannot wrap around
+        size_t available = static_cast<size_t>(fileEnd - payloadEnd);
+        const char* windowEnd = available > padding && available - padding > END_MARKER_SLACK
+                              ? payloadEnd + padding + END_MARKER_SLACK : fileEnd;
+        const char* sectionEnd = findMarker(payloadEnd, windowEnd, "--CIF-BINARY-FORMAT-SECTION----");
+        return sectionEnd == windowEnd ? fileEnd : sectionEnd;
+    }
+
+    namespace {
+
+    // Hands chunks from the calling thread to consume() on a worker thread, so
+    // the caller can produce the next chunk meanwhile. A chunk must stay
+    // valid and unchanged until it has been consumed.
+    class ChunkPipeline {
+    public:
+        static const int MAX_IN_FLIGHT = 3;
+
+        explicit ChunkPipeline(std::function<void(const uint8_t*, size_t)> consume)
+            : m_consume(consume), m_head(0), m_tail(0), m_inFlight(0), m_done(false) {
+            m_worker = std::thread(&ChunkPipeline::run, this);
+        }
+
+        ~ChunkPipeline() {
+            finish();
+        }
+
+        // Queue a chunk; waits while MAX_IN_FLIGHT chunks are queued
+        void submit(const uint8_t* chunk, size_t size) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return m_inFlight < MAX_IN_FLIGHT; });
+            m_chunks[m_head] = chunk;
+            m_sizes[m_head] = size;
+            m_head = (m_head + 1) % MAX_IN_FLIGHT;
+            ++m_inFlight;
+            m_changed.notify_all();
+        }
+
+        // Wait until every submitted chunk has been consumed
+        void drain() {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]() { return m_inFlight == 0; });
+        }
+
+        // Consume the remaining chunks and stop the worker
+        void finish() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done = true;
+                m_changed.notify_all();
+            }
+            if (m_worker.joinable()) {
+                m_worker.join();
+            }
+        }
+
+    private:
+        void run() {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                m_changed.wait(lock, [this]() { return m_inFlight > 0 || m_done; });
+                if (m_inFlight == 0) {
+                    return;
+                }
+
+                lock.unlock();
+                m_consume(m_chunks[m_tail], m_sizes[m_tail]);
+                lock.lock();
+
+                m_tail = (m_tail + 1) % MAX_IN_FLIGHT;
+                --m_inFlight;
+                m_changed.notify_all();
+            }
+        }
+
+        std::function<void(const uint8_t*, size_t)> m_consume;
+        const uint8_t* m_chunks[MAX_IN_FLIGHT];
+        size_t m_sizes[MAX_IN_FLIGHT];
+        int m_head, m_tail, m_inFlight;
+        bool m_done;
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::thread m_worker;
+    };
+
+    // X-Binary-Element-Type of each pixel type
+    template <typename T> struct ElementTraits;
+    template <> struct ElementTraits<int32_t> { static const char* const name; };
+    template <> struct ElementTraits<uint32_t> { static const char* const name; };
+    template <> struct ElementTraits<int16_t> { static const char* const name; };
+    template <> struct ElementTraits<uint16_t> { static const char* const name; };
+    const char* const ElementTraits<int32_t>::name = "signed 32-bit integer";
+    const char* const ElementTraits<uint32_t>::name = "unsigned 32-bit integer";
+    const char* const ElementTraits<int16_t>::name = "signed 16-bit integer";
+    const char* const ElementTraits<uint16_t>::name = "unsigned 16-bit integer";
+
+    } // namespace
+
+    CBFFrameBase::CBFFrameBase()
+        : width(0), height(0), integrity(IntegrityPolicy::Compute), threads(1), rowIndexRows(0), compression(Compression::ByteOffset),
+          preallocate(false), sync(SyncPolicy::None), io(IOBackend::Mapped), directIO(false), headerTemplate(nullptr),
+          m_statsDepth(0), m_pendingOffset(0),
+          m_pendingSize(0), m_payloadCompression(Compression::ByteOffset), m_headerIndexed(false) {}
+
+    void CBFFrameBase::clearFields() {
+        header.clear();
+        width = 0;
+        height = 0;
+        binaryInfo.clear();
+        rowIndex.clear();
+        m_pendingFile.reset();
+        m_headerIndexed = false;
+        m_error.clear();
+    }
+
+    HeaderIndex& CBFFrameBase::headerIndex() {
+        if (!m_headerIndexed || m_headerIndex.source() != header.data() || m_headerIndex.sourceSize() != header.size()) {
+            m_headerIndex.build(header);
+            m_headerIndexed = true;
         }
+        return m_headerIndex;
+    }
+
+    bool CBFFrameBase::parseHeader(const uint8_t* fileData, size_t fileSize, size_t& payloadOffset) {
+        // All searches run directly on the file bytes
+        const char* fileBegin = reinterpret_cast<const char*>(fileData);
+        const char* fileEnd = fileBegin + fileSize;
+        rowIndex.clear();
+        m_pendingFile.reset();
+        m_headerIndexed = false;
 
-        // Read entire file
-        std::vector<uint8_t> fileData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        file.close();
+        // Only the text in front of the magic number is searched, however
+        // large the payload behind it
+        const char* textEnd = findMagic(fileBegin, fileEnd);
 
         // Find _array_data.data section (this is where user header should end)
-        std::string fileContent(fileData.begin(), fileData.end());
-        size_t arrayDataPos = fileContent.find("_array_data.data");
-        if (arrayDataPos == std::string::npos) {
+        const char* arrayDataPos = findMarker(fileBegin, textEnd, "_array_data.data");
+        if (arrayDataPos == textEnd) {
             m_error = "Could not find _array_data.data section";
             return false;
         }
 
         // Find binary format section start
-        size_t binaryStartPos = fileContent.find("--CIF-BINARY-FORMAT-SECTION--", arrayDataPos);
-        if (binaryStartPos == std::string::npos) {
+        const char* binaryStartPos = findMarker(arrayDataPos, textEnd, "--CIF-BINARY-FORMAT-SECTION--");
+        if (binaryStartPos == textEnd) {
             m_error = "Could not find --CIF-BINARY-FORMAT-SECTION-- marker";
             return false;
         }
 
-        // Find binary format section end
-        size_t binaryEndPos = fileContent.find("--CIF-BINARY-FORMAT-SECTION----", binaryStartPos);
-        if (binaryEndPos == std::string::npos) {
-            m_error = "Could not find --CIF-BINARY-FORMAT-SECTION---- end marker";
-            return false;
-        }
-
         // Extract text header (everything before _array_data.data section)
         // Need to find the actual start of user content (after data_filename section)
-        size_t dataPos = fileContent.find("data_");
-        if (dataPos == std::string::npos) {
+        const char* dataPos = findMarker(fileBegin, arrayDataPos, "data_");
+        if (dataPos == arrayDataPos) {
             m_error = "Could not find data_ section";
             return false;
         }
 
         // Find end of data_filename line
-        size_t dataEndPos = fileContent.find("\n", dataPos);
-        if (dataEndPos == std::string::npos) {
+        const char* dataEndPos = findMarker(dataPos, arrayDataPos, "\n");
+        if (dataEndPos == arrayDataPos) {
             m_error = "Could not find end of data_ line";
             return false;
         }
 
         // Skip the empty line after data_filename
-        size_t headerStartPos = dataEndPos + 1;
-        while (headerStartPos < fileContent.size() &&
-               (fileContent[headerStartPos] == '\r' || fileContent[headerStartPos] == '\n')) {
+        const char* headerStartPos = dataEndPos + 1;
+        while (headerStartPos < fileEnd && (*headerStartPos == '\r' || *headerStartPos == '\n')) {
             headerStartPos++;
         }
 
         // Extract header from after data section to before _array_data.data
-        header = fileContent.substr(headerStartPos, arrayDataPos - headerStartPos);
+        if (headerStartPos < arrayDataPos) {
+            header.assign(headerStartPos, arrayDataPos);
+        } else {
+            header.clear();
+        }
 
-        // Extract binary section header (between the section markers)
-        std::string binaryHeader = fileContent.substr(binaryStartPos, binaryEndPos - binaryStartPos);
+        // The magic number ends the binary section header
+        if (textEnd == fileEnd) {
+            m_error = "Could not find CBF magic number after binary section header";
+            return false;
+        }
 
-        // Parse binary info from binary section header
-        int dataSize;
-        if (!parseBinaryInfo(binaryHeader, width, height, dataSize)) {
+        // Parse binary info from the MIME block between the section marker and the magic number
+        if (!parseBinaryInfo(binaryStartPos, textEnd, binaryInfo)) {
             return false;
         }
+        width = binaryInfo.width;
+        height = binaryInfo.height;
 
-        // Find magic number after the binary section header
-        auto magicIt = std::search(fileData.begin() + binaryStartPos, fileData.end(), CBF_MAGIC.begin(), CBF_MAGIC.end());
-        if (magicIt == fileData.end()) {
-            m_error = "Could not find CBF magic number after binary section header";
+        // Binary data starts right after the magic number
+        payloadOffset = static_cast<size_t>(textEnd - fileBegin) + CBF_MAGIC.size();
+        return true;
+    }
+
+    bool CBFFrameBase::parseFrame(const uint8_t* fileData, size_t fileSize, const uint8_t*& payload, size_t& payloadSize) {
+        size_t payloadOffset;
+        if (!parseHeader(fileData, fileSize, payloadOffset)) {
             return false;
         }
 
-        // Extract binary data (after magic number)
-        size_t binaryDataStart = std::distance(fileData.begin(), magicIt) + CBF_MAGIC.size();
-        if (binaryDataStart + dataSize > fileData.size()) {
+        if (binaryInfo.size > fileSize - payloadOffset) {
             m_error = "File truncated - not enough binary data";
             return false;
         }
 
-        std::vector<uint8_t> binaryData(fileData.begin() + binaryDataStart, fileData.begin() + binaryDataStart + dataSize);
-
-        // Decompress binary data
-        data = decompressData(binaryData, width, height);
+        const char* fileEnd = reinterpret_cast<const char*>(fileData) + fileSize;
+        const char* payloadEnd = reinterpret_cast<const char*>(fileData) + payloadOffset + binaryInfo.size;
+        const char* sectionEnd = findSectionEnd(payloadEnd, fileEnd, binaryInfo.padding);
+        if (sectionEnd == fileEnd) {
+            m_error = "Could not find --CIF-BINARY-FORMAT-SECTION---- end marker";
+            return false;
+        }
 
+        payload = fileData + payloadOffset;
+        payloadSize = binaryInfo.size;
+        parseRowIndex(sectionEnd, fileEnd, payloadSize);
         return true;
     }
 
-    bool CBFFrame::write(const std::string& filename) const {
-        if (data.empty() || width == 0 || height == 0) {
+    bool CBFFrameBase::readHeader(const std::string& filename) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            m_error = "Could not open file: " + filename;
             return false;
         }
 
-        std::ofstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            return false;
+        // Read the file in growing chunks until the whole text header and the
+        // MIME block of the binary section are available. Everything parseHeader
+        // needs lies in front of the magic number, so once it is in the prefix
+        // a failure is final; a file without one is given up on after
+        // MAX_HEADER_READ_SIZE bytes instead of being read to the end.
+        std::vector<uint8_t>& prefix = m_scratch;
+        prefix.clear();
+        size_t chunk = HEADER_READ_SIZE;
+        bool parsed;
+        while (true) {
+            size_t available = prefix.size();
+            prefix.resize(available + chunk);
+            {
+                NANOCBF_STAGE(m_stats, Stage::Read, chunk);
+                file.read(reinterpret_cast<char*>(prefix.data() + available), chunk);
+            }
+            prefix.resize(available + static_cast<size_t>(file.gcount()));
+
+            size_t payloadOffset;
+            NANOCBF_STAGE(m_stats, Stage::Parse, prefix.size());
+            parsed = parseHeader(prefix.data(), prefix.size(), payloadOffset);
+            // Stop at the end of file; m_error then describes what was missing
+            if (parsed || !file) {
+                break;
+            }
+            const char* begin = reinterpret_cast<const char*>(prefix.data());
+            if (findMagic(begin, begin + prefix.size()) != begin + prefix.size()) {
+                break;
+            }
+            if (prefix.size() >= MAX_HEADER_READ_SIZE) {
+                m_error += " in the first " + std::to_string(prefix.size()) + " bytes";
+                break;
+            }
+            chunk = std::min(prefix.size(), MAX_HEADER_READ_SIZE - prefix.size());
         }
 
-        // Compress binary data first to get size and MD5
-        std::vector<uint8_t> compressed = compressData(data);
+        prefix.clear();
+        return parsed;
+    }
 
-        // Write CBF prefix (version and data section name)
-        std::string cbfPrefix = generateCbfPrefix(filename);
-        file.write(cbfPrefix.c_str(), cbfPrefix.size());
+    template <typename T>
+    BasicCBFFrame<T>::BasicCBFFrame() {}
 
-        // Write user header or default header if empty
-        std::string headerToWrite = header.empty() ? generateDefaultHeader() : header;
-        file.write(headerToWrite.c_str(), headerToWrite.size());
+    template <typename T>
+    BasicCBFFrame<T>::BasicCBFFrame(const uint8_t* image, size_t size) {
+      decode(image, size);
+    }
 
-        // Generate and write _array_data.data section
-        std::string arrayDataSection = generateArrayDataSection(compressed);
-        file.write(arrayDataSection.c_str(), arrayDataSection.size());
+    template <typename T>
+    BasicCBFFrame<T>::BasicCBFFrame(const std::string& filename, bool lazy) {
+      if (lazy) {
+          open(filename);
+      } else {
+          read(filename);
+      }
+    }
 
-        // Write magic number
-        file.write(reinterpret_cast<const char*>(CBF_MAGIC.data()), CBF_MAGIC.size());
+    template <typename T>
+    BasicCBFFrame<T>::~BasicCBFFrame() {}
 
-        // Write compressed binary data
-        file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    template <typename T>
+    void BasicCBFFrame<T>::clear() {
+        clearFields();
+        data.clear();
+    }
 
-        // Write tail
-        file.write(CBF_TAIL.c_str(), CBF_TAIL.size());
+    template <typename T>
+    const char* BasicCBFFrame<T>::elementType() {
+        return ElementTraits<T>::name;
+    }
 
+    template <typename T>
+    bool BasicCBFFrame<T>::readHeader(const std::string& filename) {
+        if (!CBFFrameBase::readHeader(filename)) {
+            return false;
+        }
+        data.clear();
         return true;
     }
 
+    bool CBFFrameBase::loadFile(MappedFile& file, const std::string& filename, FileAccess access, bool mapOnly,
+                                const uint8_t*& image, size_t& size) {
+        if (mapOnly || io == IOBackend::Mapped) {
+            {
+                NANOCBF_STAGE(m_stats, Stage::Read, 0);
+                if (!file.open(filename, access)) {
+                    m_error = "Could not open file: " + filename;
+                    return false;
+                }
+            }
+            image = file.data();
+            size = file.size();
+        } else {
+            NANOCBF_STAGE(m_stats, Stage::Read, 0);
+            if (!m_reader.reader || m_reader.backend != io || m_reader.direct != directIO) {
+                m_reader.reader = FileReader::create(io, directIO, 1);
+                m_reader.backend = io;
+                m_reader.direct = directIO;
+            }
+            m_reader.request.filename = filename;
+            if (!m_reader.reader->read(&m_reader.request, 1)) {
+                m_error = m_reader.request.error;
+                return false;
+            }
+            image = m_reader.request.buffer.data();
+            size = m_reader.request.buffer.size();
+        }
+        NANOCBF_STAGE_BYTES(m_stats, Stage::Read, size);
+        return true;
+    }
 
-    bool CBFFrame::parseBinaryInfo(const std::string& header, int& width, int& height, int& dataSize) {
-        std::regex widthRegex(R"(X-Binary-Size-Fastest-Dimension:\s+(\d+))");
-        std::regex heightRegex(R"(X-Binary-Size-Second-Dimension:\s+(\d+))");
-        std::regex sizeRegex(R"(X-Binary-Size:\s+(\d+))");
-        std::regex md5Regex(R"(Content-MD5:\s+([^\r\n]+))");
+    bool CBFFrameBase::openFrame(MappedFile& file, const std::string& filename, int pixelBits, bool pixelSigned,
+                                 const uint8_t*& payload, size_t& payloadSize, FileAccess access, bool mapOnly) {
+        const uint8_t* image;
+        size_t size;
+        return loadFile(file, filename, access, mapOnly, image, size) && locateFrame(image, size, pixelBits, pixelSigned, payload, payloadSize);
+    }
 
-        std::smatch match;
+    bool CBFFrameBase::locateFrame(const uint8_t* image, size_t size, int pixelBits, bool pixelSigned, const uint8_t*& payload,
+                                   size_t& payloadSize) {
+        NANOCBF_STAGE(m_stats, Stage::Parse, size);
+        return parseFrame(image, size, payload, payloadSize) && checkElementType(pixelBits, pixelSigned) && checkCompression();
+    }
 
-        if (!std::regex_search(header, match, widthRegex)) {
-            m_error = "Could not find width in header";
+    bool CBFFrameBase::locateSection(const uint8_t* image, size_t size, const BinarySection& section, int pixelBits, bool pixelSigned,
+                                     const uint8_t*& payload, size_t& payloadSize) {
+        NANOCBF_STAGE(m_stats, Stage::Parse, section.payloadOffset - section.headerBegin);
+        rowIndex.clear();
+        m_pendingFile.reset();
+        m_headerIndexed = false;
+        if (section.limit > size || section.end > section.limit || section.headerBegin > section.headerEnd ||
+            section.headerEnd > section.payloadOffset || section.payloadOffset > section.end ||
+            section.info.size > section.end - section.payloadOffset) {
+            m_error = "Binary section lies outside the file image";
             return false;
         }
-        width = std::stoi(match[1].str());
 
-        if (!std::regex_search(header, match, heightRegex)) {
-            m_error = "Could not find height in header";
+        const char* text = reinterpret_cast<const char*>(image);
+        header.assign(text + section.headerBegin, text + section.headerEnd);
+        binaryInfo = section.info;
+        width = binaryInfo.width;
+        height = binaryInfo.height;
+
+        payload = image + section.payloadOffset;
+        payloadSize = binaryInfo.size;
+        parseRowIndex(text + section.end, text + section.limit, payloadSize);
+        return checkElementType(pixelBits, pixelSigned) && checkCompression();
+    }
+
+    // Start of the last line in [from, end) that begins with "data_", or end
+    static const char* findLastBlock(const char* fileBegin, const char* from, const char* end) {
+        const char* last = end;
+        for (const char* p = findMarker(from, end, "data_"); p != end; p = findMarker(p + 1, end, "data_")) {
+            if (p == fileBegin || p[-1] == '\n') {
+                last = p;
+            }
+        }
+        return last;
+    }
+
+    bool CBFFrameBase::findSections(const uint8_t* image, size_t size, std::vector<BinarySection>& sections) {
+        sections.clear();
+        const char* fileBegin = reinterpret_cast<const char*>(image);
+        const char* fileEnd = fileBegin + size;
+        static const char SECTION_START[] = "--CIF-BINARY-FORMAT-SECTION--";
+        static const char SECTION_END[] = "--CIF-BINARY-FORMAT-SECTION----";
+
+        BinarySection block;        // Block fields of the data block being scanned
+        bool inBlock = false;
+        const char* position = fileBegin;
+        while (true) {
+            // The section's text ends at the next magic number, so the
+            // markers are never searched for in compressed data
+            const char* textEnd = findMagic(position, fileEnd);
+            const char* sectionStart = findMarker(position, textEnd, SECTION_START);
+            if (sectionStart == textEnd) {
+                if (textEnd != fileEnd) {
+                    m_error = "Could not find --CIF-BINARY-FORMAT-SECTION-- marker";
+                    return false;
+                }
+                break;
+            }
+
+            // A data_ line in front of the section starts a new data block,
+            // otherwise the section belongs to the current one
+            const char* regionStart = sectionStart;
+            const char* blockStart = findLastBlock(fileBegin, position, sectionStart);
+            if (blockStart != sectionStart) {
+                const char* nameEnd = std::find(blockStart, sectionStart, '\n');
+                const char* headerStart = nameEnd;
+                while (headerStart < sectionStart && (*headerStart == '\r' || *headerStart == '\n')) {
+                    headerStart++;
+                }
+                const char* arrayDataPos = findMarker(headerStart, sectionStart, "_array_data.data");
+                if (arrayDataPos == sectionStart) {
+                    m_error = "Could not find _array_data.data section";
+                    return false;
+                }
+                if (nameEnd > blockStart + 5 && nameEnd[-1] == '\r') {
+                    --nameEnd;
+                }
+
+                block.blockName.assign(blockStart + 5, nameEnd);
+                block.headerBegin = static_cast<size_t>(headerStart - fileBegin);
+                block.headerEnd = static_cast<size_t>(arrayDataPos - fileBegin);
+                regionStart = blockStart;
+                inBlock = true;
+            } else if (!inBlock) {
+                m_error = "Could not find data_ section";
+                return false;
+            }
+            if (!sections.empty()) {
+                sections.back().limit = static_cast<size_t>(regionStart - fileBegin);
+            }
+
+            // MIME block between the section marker and the magic number
+            if (textEnd == fileEnd) {
+                m_error = "Could not find CBF magic number after binary section header";
+                return false;
+            }
+            sections.push_back(block);
+            BinarySection& section = sections.back();
+            if (!parseBinaryInfo(sectionStart, textEnd, section.info)) {
+                return false;
+            }
+
+            section.payloadOffset = static_cast<size_t>(textEnd - fileBegin) + CBF_MAGIC.size();
+            if (section.info.size > size - section.payloadOffset) {
+                m_error = "File truncated - not enough binary data";
+                return false;
+            }
+            const char* sectionEnd = findSectionEnd(fileBegin + section.payloadOffset + section.info.size, fileEnd, section.info.padding);
+            if (sectionEnd == fileEnd) {
+                m_error = "Could not find --CIF-BINARY-FORMAT-SECTION---- end marker";
+                return false;
+            }
+            section.end = static_cast<size_t>(sectionEnd - fileBegin) + std::strlen(SECTION_END);
+            section.limit = size;
+            position = fileBegin + section.end;
+        }
+
+        if (sections.empty()) {
+            m_error = "Could not find --CIF-BINARY-FORMAT-SECTION-- marker";
             return false;
         }
-        height = std::stoi(match[1].str());
+        return true;
+    }
 
-        if (!std::regex_search(header, match, sizeRegex)) {
-            m_error = "Could not find data size in header";
+    bool CBFFrameBase::checkCapacity(size_t capacity) {
+        if (static_cast<size_t>(width) * static_cast<size_t>(height) > capacity) {
+            m_error = "Output buffer too small for " + std::to_string(width) + "x" + std::to_string(height) + " frame";
             return false;
         }
-        dataSize = std::stoi(match[1].str());
+        return true;
+    }
 
-        // MD5 is optional - some files may not have it
-        if (std::regex_search(header, match, md5Regex)) {
-            // Store MD5 for potential validation (though we don't validate it currently)
-            std::string md5Hash = match[1].str();
-            // Could add validation here if needed: validateMD5(md5Hash, binaryData);
+    bool CBFFrameBase::checkDecoded(size_t decoded) {
+        if (decoded != static_cast<size_t>(width) * static_cast<size_t>(height)) {
+            m_error = "Binary data ended before all pixels were decoded";
+            return false;
         }
+        return true;
+    }
 
+    bool CBFFrameBase::verifyContentMD5(MD5State& md5) {
+        uint8_t digest[16];
+        md5Final(md5, digest);
+        char md5Hash[MD5_BASE64_WIDTH];
+        writeBase64(digest, 16, md5Hash);
+        if (binaryInfo.contentMD5.compare(0, std::string::npos, md5Hash, MD5_BASE64_WIDTH) != 0) {
+            m_error = "Content-MD5 mismatch - binary data is corrupted";
+            return false;
+        }
         return true;
     }
 
-    std::vector<uint8_t> CBFFrame::compressData(const std::vector<int32_t>& data) const {
-        std::vector<uint8_t> compressed;
+    // Parse a signed decimal at p, advancing p; returns false if there is none
+    // or it does not fit in an int64_t
+    static bool parseNumber(const char*& p, const char* end, int64_t& value) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        bool negative = p < end && *p == '-';
+        if (negative) ++p;
+        if (p == end || *p < '0' || *p > '9') return false;
+        const int64_t maxValue = std::numeric_limits<int64_t>::max();
+        value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            int digit = *p - '0';
+            if (value > (maxValue - digit) / 10) return false;
+            value = value * 10 + digit;
+        }
+        if (negative) value = -value;
+        return true;
+    }
 
-        int32_t currentValue = 0;
-        for (int32_t pixel : data) {
-            int32_t delta = pixel - currentValue;
+    void CBFFrameBase::parseRowIndex(const char* begin, const char* end, size_t payloadSize) {
+        rowIndex.clear();
+        const char* rowsItem = findMarker(begin, end, "_nanocbf_row_index.rows_per_entry");
+        const char* entriesItem = findMarker(begin, end, "_nanocbf_row_index.entries");
+        if (rowsItem == end || entriesItem == end) {
+            return;
+        }
 
-            if (delta >= -127 && delta <= 127) {
-                // 8-bit delta
-                compressed.push_back(static_cast<uint8_t>(delta));
-            } else if (delta >= -32767 && delta <= 32767) {
-                // 16-bit delta
-                compressed.push_back(0x80);
-                writeInt16LE(compressed, static_cast<int16_t>(delta));
-            } else {
-                // 32-bit delta
-                compressed.push_back(0x80);
-                writeInt16LE(compressed, static_cast<int16_t>(0x8000));
-                writeInt32LE(compressed, delta);
+        const char* p = rowsItem + std::strlen("_nanocbf_row_index.rows_per_entry");
+        int64_t rows;
+        if (!parseNumber(p, end, rows) || rows <= 0) {
+            return;
+        }
+
+        // Text field: one "position value" line per entry between ';' lines
+        p = findMarker(entriesItem, end, "\n;");
+        if (p != end) p += 2;
+        size_t expected = (static_cast<size_t>(height) + static_cast<size_t>(rows) - 1) / static_cast<size_t>(rows);
+        std::vector<ByteOffsetState>& entries = rowIndex.entries;
+        while (p < end) {
+            while (p < end && *p != '\n') ++p;
+            ++p;
+            int64_t position, value;
+            if (p >= end || *p == ';' || !parseNumber(p, end, position) || !parseNumber(p, end, value)) {
+                break;
             }
+            // Every row starts inside the payload, after the rows in front of it
+            if (position < 0 || static_cast<uint64_t>(position) >= payloadSize ||
+                value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max() ||
+                (!entries.empty() && static_cast<size_t>(position) <= entries.back().pos)) {
+                break;
+            }
+            ByteOffsetState entry;
+            entry.pos = static_cast<size_t>(position);
+            entry.value = static_cast<int32_t>(value);
+            entries.push_back(entry);
+        }
 
-            currentValue = pixel;
+        if (height > 0 && !entries.empty() && entries.size() == expected && entries[0].pos == 0 && entries[0].value == 0) {
+            rowIndex.rowsPerEntry = static_cast<size_t>(rows);
+        } else {
+            rowIndex.clear();
         }
+    }
 
-        return compressed;
+    std::string CBFFrameBase::generateRowIndexItem(const std::vector<ByteOffsetState>& entries) const {
+        std::ostringstream oss;
+        oss << "_nanocbf_row_index.rows_per_entry " << rowIndexRows << "\r\n"
+            << "_nanocbf_row_index.entries\r\n"
+            << ";\r\n";
+        for (size_t i = 0; i < entries.size(); ++i) {
+            oss << entries[i].pos << " " << entries[i].value << "\r\n";
+        }
+        oss << ";\r\n";
+        return oss.str();
     }
 
-    std::vector<int32_t> CBFFrame::decompressData(const std::vector<uint8_t>& compressed, int width, int height) const {
-        std::vector<int32_t> data;
-        data.reserve(width * height);
+    bool CBFFrameBase::readRegion(const std::string& filename, const DecodeRegion& region, int32_t* out, size_t capacity) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        MappedFile file(&m_scratch);
+        const uint8_t* payload;
+        size_t payloadSize;
+        // Only the rows from the index entry in front of the region are read
+        if (!openFrame(file, filename, 32, true, payload, payloadSize, FileAccess::Normal) || !checkByteOffset("readRegion")) {
+            return false;
+        }
 
-        int32_t currentValue = 0;
-        size_t pos = 0;
+        // Compare against the room left after x and y so a huge width or height cannot wrap around
+        if (width < 0 || height < 0 || region.bin == 0 ||
+            region.x > static_cast<size_t>(width) || region.width > static_cast<size_t>(width) - region.x ||
+            region.y > static_cast<size_t>(height) || region.height > static_cast<size_t>(height) - region.y) {
+            m_error = "Region is outside the " + std::to_string(width) + "x" + std::to_string(height) + " frame";
+            return false;
+        }
+        if (region.outputWidth() * region.outputHeight() > capacity) {
+            m_error = "Output buffer too small for region";
+            return false;
+        }
 
-        while (pos < compressed.size() && data.size() < width * height) {
-            int8_t delta8 = static_cast<int8_t>(compressed[pos++]);
+        // Start from the last indexed row in front of the region
+        ByteOffsetState state;
+        size_t firstRow = 0;
+        if (rowIndex.rowsPerEntry > 0 && !rowIndex.entries.empty()) {
+            size_t entry = std::min(region.y / rowIndex.rowsPerEntry, rowIndex.entries.size() - 1);
+            state = rowIndex.entries[entry];
+            firstRow = entry * rowIndex.rowsPerEntry;
+            if (state.pos >= payloadSize) {
+                m_error = "Row index entry lies outside the binary data";
+                return false;
+            }
+        }
 
-            if (static_cast<uint8_t>(delta8) == 0x80) {
-                // 16-bit or 32-bit delta
-                if (pos + 1 >= compressed.size()) break;
+        NANOCBF_STAGE(m_stats, Stage::Decode, payloadSize - state.pos);
+        if (!decodeByteOffsetRegion(payload, payloadSize, width, region, out, state, firstRow)) {
+            m_error = "Binary data ended before all pixels were decoded";
+            return false;
+        }
+        return true;
+    }
 
-                int16_t delta16 = readInt16LE(&compressed[pos]);
-                pos += 2;
+    // Hash each block of the payload right before decoding it with
+    // decodeBlock(blockEnd, state, decoded), so the compressed data is only
+    // brought into cache once. Returns the number of pixels decoded.
+    template <typename DecodeBlock>
+    static size_t decodeHashed(const uint8_t* payload, size_t size, size_t blockSize, MD5State& md5, Stats& stats,
+                               DecodeBlock decodeBlock) {
+        ByteOffsetState state;
+        size_t decoded = 0;
+        for (size_t blockStart = 0; blockStart < size; blockStart += blockSize) {
+            size_t blockEnd = std::min(size, blockStart + blockSize);
+            {
+                NANOCBF_STAGE(stats, Stage::Hash, blockEnd - blockStart);
+                md5Update(md5, payload + blockStart, blockEnd - blockStart);
+            }
 
-                if (static_cast<uint16_t>(delta16) == 0x8000) {
-                    // 32-bit delta
-                    if (pos + 3 >= compressed.size()) break;
+            // An escape sequence cut by the block end is picked up with the next block
+            NANOCBF_STAGE(stats, Stage::Decode, blockEnd - blockStart);
+            decoded += decodeBlock(blockEnd, state, decoded);
+        }
+        return decoded;
+    }
 
-                    int32_t delta32 = readInt32LE(&compressed[pos]);
-                    pos += 4;
+    template <typename T>
+    bool BasicCBFFrame<T>::open(const std::string& filename) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        // Owns its fallback buffer, which has to outlive this call
+        std::shared_ptr<MappedFile> file(new MappedFile());
+        const uint8_t* payload;
+        size_t payloadSize;
+        data.clear();
+        // Only the header is read until pixels() is called
+        if (!openFrame(*file, filename, 8 * sizeof(T), std::is_signed<T>::value, payload, payloadSize, FileAccess::Random, true)) {
+            return false;
+        }
 
-                    currentValue += delta32;
-                } else {
-                    currentValue += delta16;
-                }
-            } else {
-                // 8-bit delta
-                currentValue += delta8;
-            }
+        m_pendingFile = file;
+        m_pendingOffset = static_cast<size_t>(payload - file->data());
+        m_pendingSize = payloadSize;
+        return true;
+    }
 
-            data.push_back(currentValue);
+    template <typename T>
+    const std::vector<T>& BasicCBFFrame<T>::pixels() {
+        if (m_pendingFile) {
+            NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+            // Decode once, then let go of the mapping
+            std::shared_ptr<MappedFile> file;
+            file.swap(m_pendingFile);
+            file->advise(decodeAccess());
+
+            size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+            data.resize(pixelCount);
+            size_t decoded;
+            if (decodePayload(file->data() + m_pendingOffset, m_pendingSize, data.data(), pixelCount, decoded)) {
+                checkDecoded(decoded);
+            }
+            data.resize(decoded);
         }
-
         return data;
     }
 
-    void CBFFrame::writeInt16LE(std::vector<uint8_t>& buffer, int16_t value) const {
-        buffer.push_back(static_cast<uint8_t>(value & 0xFF));
-        buffer.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
+    template <typename T>
+    bool BasicCBFFrame<T>::read(const std::string& filename) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        MappedFile file(&m_scratch);
+        const uint8_t* image;
+        size_t size;
+        return loadFile(file, filename, decodeAccess(), false, image, size) && decode(image, size);
     }
 
-    void CBFFrame::writeInt32LE(std::vector<uint8_t>& buffer, int32_t value) const {
-        buffer.push_back(static_cast<uint8_t>(value & 0xFF));
-        buffer.push_back(static_cast<uint8_t>((value >> 8) & 0xFF));
-        buffer.push_back(static_cast<uint8_t>((value >> 16) & 0xFF));
-        buffer.push_back(static_cast<uint8_t>((value >> 24) & 0xFF));
+    template <typename T>
+    bool BasicCBFFrame<T>::decode(const uint8_t* image, size_t size) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        const uint8_t* payload;
+        size_t payloadSize;
+        return locateFrame(image, size, 8 * sizeof(T), std::is_signed<T>::value, payload, payloadSize) && decodeInto(payload, payloadSize);
     }
 
-    uint16_t CBFFrame::readInt16LE(const uint8_t* buffer) const {
-        return static_cast<uint16_t>(buffer[0]) | (static_cast<uint16_t>(buffer[1]) << 8);
+    template <typename T>
+    bool BasicCBFFrame<T>::decode(const uint8_t* image, size_t size, const BinarySection& section) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        const uint8_t* payload;
+        size_t payloadSize;
+        return locateSection(image, size, section, 8 * sizeof(T), std::is_signed<T>::value, payload, payloadSize) && decodeInto(payload, payloadSize);
     }
 
-    uint32_t CBFFrame::readInt32LE(const uint8_t* buffer) const {
-        return static_cast<uint32_t>(buffer[0]) |
-               (static_cast<uint32_t>(buffer[1]) << 8) |
-               (static_cast<uint32_t>(buffer[2]) << 16) |
-               (static_cast<uint32_t>(buffer[3]) << 24);
+    template <typename T>
+    bool BasicCBFFrame<T>::decodeInto(const uint8_t* payload, size_t size) {
+        // Decompress straight from the image into data; resizing is a
+        // no-op when data already holds a frame of the same size
+        size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+        data.resize(pixelCount);
+        size_t decoded;
+        bool verified = decodePayload(payload, size, data.data(), pixelCount, decoded);
+        data.resize(decoded);
+
+        return verified;
     }
 
-    std::string CBFFrame::generateArrayDataSection(const std::vector<uint8_t>& compressedData) const {
-        std::string md5Hash = generateMD5(compressedData);
-
-        std::ostringstream oss;
-        oss << "_array_data.data\r\n"
-            << ";\r\n"
-            << "--CIF-BINARY-FORMAT-SECTION--\r\n"
-            << "Content-Type: application/octet-stream;\r\n"
-            << "     conversions=\"x-CBF_BYTE_OFFSET\"\r\n"
-            << "Content-Transfer-Encoding: BINARY\r\n"
-            << "X-Binary-Size: " << compressedData.size() << "\r\n"
-            << "X-Binary-ID: 1\r\n"
-            << "X-Binary-Element-Type: \"signed 32-bit integer\"\r\n"
-            << "X-Binary-Element-Byte-Order: LITTLE_ENDIAN\r\n"
-            << "Content-MD5: " << md5Hash << "\r\n"
-            << "X-Binary-Number-of-Elements: " << (width * height) << "\r\n"
-            << "X-Binary-Size-Fastest-Dimension: " << width << "\r\n"
-            << "X-Binary-Size-Second-Dimension: " << height << "\r\n"
-            << "X-Binary-Size-Padding: 4095\r\n\r\n";
+    template <typename T>
+    bool BasicCBFFrame<T>::read(const std::string& filename, T* out, size_t capacity) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        MappedFile file(&m_scratch);
+        const uint8_t* payload;
+        size_t payloadSize;
+        if (!openFrame(file, filename, 8 * sizeof(T), std::is_signed<T>::value, payload, payloadSize, decodeAccess()) ||
+            !checkCapacity(capacity)) {
+            return false;
+        }
 
-        return oss.str();
+        size_t decoded;
+        size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+        return decodePayload(payload, payloadSize, out, pixelCount, decoded) && checkDecoded(decoded);
     }
 
-    std::string CBFFrame::generateCbfPrefix(const std::string& filename) const {
-        std::string baseName = extractBaseName(filename);
-
-        std::ostringstream oss;
-        oss << "###CBF: VERSION 1.5 generated by nanocbf\r\n"
-            << "data_" << baseName << "\r\n\r\n";
+    template <typename T>
+    bool BasicCBFFrame<T>::read(const std::string& filename, float* out, size_t capacity, const PixelCorrection& correction) {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        // Any integer element type of up to 32 bits converts to float; unsigned
+        // 32-bit data fits the 64-bit signed check and is narrowed below
+        MappedFile file(&m_scratch);
+        const uint8_t* payload;
+        size_t payloadSize;
+        if (!openFrame(file, filename, 64, true, payload, payloadSize, decodeAccess()) || !checkCapacity(capacity) ||
+            !checkByteOffset("Float read")) {
+            return false;
+        }
+        if (elementTypeBits(binaryInfo.elementType) > 32) {
+            m_error = "Element type \"" + binaryInfo.elementType + "\" does not fit in 32-bit pixels";
+            return false;
+        }
+        PixelCorrection rawCorrection = correction;
+        rawCorrection.rawUnsigned = correction.rawUnsigned || elementTypeUnsigned(binaryInfo.elementType);
+
+        size_t pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+        size_t decoded;
+        if (integrity == IntegrityPolicy::Verify && !binaryInfo.contentMD5.empty()) {
+            MD5State md5;
+            decoded = decodeHashed(payload, payloadSize, VERIFY_BLOCK_SIZE, md5, m_stats, [&](size_t blockEnd, ByteOffsetState& state, size_t done) {
+                return decodeByteOffsetCorrected(payload, blockEnd, state, out + done, pixelCount - done, rawCorrection.from(done));
+            });
+            if (!verifyContentMD5(md5)) {
+                return false;
+            }
+        } else if (threads > 1 && pixelCount >= PARALLEL_DECODE_PIXELS) {
+            NANOCBF_STAGE(m_stats, Stage::Decode, payloadSize);
+            decoded = decodeByteOffsetCorrectedParallel(payload, payloadSize, out, pixelCount, rawCorrection, threads);
+        } else {
+            NANOCBF_STAGE(m_stats, Stage::Decode, payloadSize);
+            ByteOffsetState state;
+            decoded = decodeByteOffsetCorrected(payload, payloadSize, state, out, pixelCount, rawCorrection);
+        }
 
-        return oss.str();
+        return checkDecoded(decoded);
     }
 
-    std::string CBFFrame::generateDefaultHeader() const {
-        std::ostringstream oss;
-        oss << "_array_data.header_convention \"nanocbf empty\"\r\n"
-            << "_array_data.header_contents\r\n"
-            << ";\r\n"
-            << ";\r\n\r\n";
+    template <typename T>
+    bool BasicCBFFrame<T>::decodePayload(const uint8_t* payload, size_t size, T* out, size_t count, size_t& decoded) {
+        if (integrity != IntegrityPolicy::Verify || binaryInfo.contentMD5.empty()) {
+            NANOCBF_STAGE(m_stats, Stage::Decode, size);
+            decoded = decompressData(payload, size, out, count);
+            return true;
+        }
 
-        return oss.str();
+        MD5State md5;
+        if (m_payloadCompression != Compression::ByteOffset) {
+            {
+                NANOCBF_STAGE(m_stats, Stage::Hash, size);
+                md5Update(md5, payload, size);
+            }
+            NANOCBF_STAGE(m_stats, Stage::Decode, size);
+            decoded = decompressData(payload, size, out, count);
+            return verifyContentMD5(md5);
+        }
+        decoded = decodeHashed(payload, size, VERIFY_BLOCK_SIZE, md5, m_stats, [&](size_t blockEnd, ByteOffsetState& state, size_t done) {
+            return decodeByteOffset(payload, blockEnd, state, out + done, count - done);
+        });
+        return verifyContentMD5(md5);
     }
 
-    std::string CBFFrame::extractBaseName(const std::string& filepath) const {
-        // Find last slash or backslash for directory separation
-        size_t lastSlash = filepath.find_last_of("/\\");
-        std::string filename = (lastSlash == std::string::npos) ? filepath : filepath.substr(lastSlash + 1);
+    template <typename T>
+    bool BasicCBFFrame<T>::write(const std::string& filename) const {
+        if (data.empty() || width == 0 || height == 0 || !enabledCompression(compression)) {
+            return false;
+        }
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+
+        // Prefix and _array_data.data section in one reused buffer, with
+        // placeholders for size and MD5 that are filled in once the data has
+        // been compressed; the header text is written from where it is
+        bool hashing = integrity != IntegrityPolicy::None;
+        size_t sizeOffset, md5Offset;
+        m_head.clear();
+        appendCbfPrefix(m_head, filename);
+        size_t prefixSize = m_head.size();
+        appendArrayDataSection(m_head, elementType(), hashing, sizeOffset, md5Offset);
+        const std::string& text = headerText();
+
+        MD5State md5;
+
+        // With IntegrityPolicy::Async chunks are hashed on a worker thread
+        // while the next one is being compressed
+        bool chunked = compression == Compression::ByteOffset;
+        std::unique_ptr<ChunkPipeline> hasher;
+        if (chunked && integrity == IntegrityPolicy::Async) {
+            hasher.reset(new ChunkPipeline([&](const uint8_t* bytes, size_t length) {
+                NANOCBF_STAGE(m_stats, Stage::Hash, length);
+                md5Update(md5, bytes, length);
+            }));
+        }
 
-        // Remove .cbf extension if present
-        size_t dotPos = filename.find_last_of('.');
-        if (dotPos != std::string::npos && filename.substr(dotPos) == ".cbf") {
-            filename = filename.substr(0, dotPos);
+        // Compress and hash the data one cache-sized chunk at a time into the
+        // scratch buffer; chunks also end at row index entries, so their
+        // positions are known. The row index only applies to x-CBF_BYTE_OFFSET data.
+        size_t entryPixels = chunked ? rowIndexRows * static_cast<size_t>(width) : 0;
+        std::vector<ByteOffsetState> entries;
+        size_t compressedSize = 0;
+        if (!chunked) {
+            m_scratch.resize(wholeFrameMaxSize(data.size()));
+            {
+                NANOCBF_STAGE(m_stats, Stage::Compress, data.size() * sizeof(T));
+                compressedSize = compressWholeFrame(data.data(), data.size(), m_scratch.data());
+            }
+            if (hashing) {
+                NANOCBF_STAGE(m_stats, Stage::Hash, compressedSize);
+                md5Update(md5, m_scratch.data(), compressedSize);
+            }
         }
+        for (size_t start = 0, count; chunked && start < data.size(); start += count) {
+            count = std::min(data.size() - start, static_cast<size_t>(WRITE_CHUNK_PIXELS));
+            int32_t previous = start > 0 ? static_cast<int32_t>(data[start - 1]) : 0;
+            if (entryPixels > 0) {
+                if (start % entryPixels == 0) {
+                    ByteOffsetState entry;
+                    entry.pos = compressedSize;
+                    entry.value = previous;
+                    entries.push_back(entry);
+                }
+                count = std::min(count, entryPixels - start % entryPixels);
+            }
 
-        // Replace all whitespace characters with underscores
-        for (char& c : filename) {
-            if (std::isspace(c)) {
-                c = '_';
+            size_t needed = compressedSize + byteOffsetMaxSize(count);
+            if (needed > m_scratch.size()) {
+                // Growing past the capacity moves the buffer, so the hasher has to catch up first
+                size_t grown = std::max(needed, 2 * m_scratch.size());
+                if (hasher && grown > m_scratch.capacity()) {
+                    hasher->drain();
+                }
+                m_scratch.resize(grown);
+            }
+            uint8_t* out = m_scratch.data() + compressedSize;
+            size_t chunkSize;
+            {
+                NANOCBF_STAGE(m_stats, Stage::Compress, count * sizeof(T));
+                chunkSize = encodeByteOffset(data.data() + start, count, out, previous);
+            }
+
+            if (hasher) {
+                hasher->submit(out, chunkSize);
+            } else if (hashing) {
+                NANOCBF_STAGE(m_stats, Stage::Hash, chunkSize);
+                md5Update(md5, out, chunkSize);
             }
+            compressedSize += chunkSize;
+        }
+        if (hasher) {
+            hasher->finish();
+        }
+
+        writeBinarySize(compressedSize, &m_head[sizeOffset]);
+        if (hashing) {
+            uint8_t digest[16];
+            md5Final(md5, digest);
+            writeBase64(digest, 16, &m_head[md5Offset]);
         }
 
-        return filename;
+        // Prefix, header, binary section, data, tail and the row index item
+        // after the binary section go out in one gather write
+        std::string indexItem = entryPixels > 0 ? generateRowIndexItem(entries) : std::string();
+        FilePart parts[] = {
+            {m_head.data(), prefixSize},
+            {text.data(), text.size()},
+            {m_head.data() + prefixSize, m_head.size() - prefixSize},
+            {m_scratch.data(), compressedSize},
+            {CBF_TAIL.data(), CBF_TAIL.size()},
+            {indexItem.data(), indexItem.size()}
+        };
+        bool written;
+        {
+            NANOCBF_STAGE(m_stats, Stage::Write, m_head.size() + text.size() + compressedSize + CBF_TAIL.size() + indexItem.size());
+            written = writeFile(filename, parts, 6, preallocate, sync);
+        }
+        m_scratch.clear();
+        return written;
     }
 
-    // Complete MD5 implementation
-    std::string CBFFrame::generateMD5(const std::vector<uint8_t>& data) const {
-        // MD5 initialization
-        uint32_t state[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
-        uint64_t count = 0;
-        uint8_t buffer[64] = {0};
+    template <typename T>
+    size_t BasicCBFFrame<T>::wholeFrameMaxSize(size_t count) const {
+        return compression == Compression::None ? count * sizeof(T) : packedMaxSize(count);
+    }
 
-        // Process the data
-        md5Update(state, count, buffer, data.data(), data.size());
+    template <typename T>
+    size_t BasicCBFFrame<T>::compressWholeFrame(const T* pixels, size_t count, uint8_t* out) const {
+        if (compression == Compression::None) {
+            return encodeUncompressed(pixels, count, out);
+        }
+        return encodePacked(pixels, count, static_cast<size_t>(width), compression == Compression::PackedV2, out);
+    }
 
-        // Finalize and get digest
-        uint8_t digest[16];
-        md5Final(digest, state, count, buffer);
+    template <typename T>
+    bool BasicCBFFrame<T>::encode(const std::string& filename, std::vector<uint8_t>& out) const {
+        return !data.empty() && encodePixels(data.data(), data.size(), filename, out);
+    }
 
-        // Convert to base64 for CBF format
-        return bytesToBase64(digest, 16);
+    template <typename T>
+    bool BasicCBFFrame<T>::encode(const T* pixels, const std::string& filename, std::vector<uint8_t>& out) const {
+        return pixels && encodePixels(pixels, static_cast<size_t>(width) * static_cast<size_t>(height), filename, out);
     }
 
-    std::string CBFFrame::bytesToHex(const uint8_t* bytes, size_t length) {
-        std::ostringstream oss;
-        for (size_t i = 0; i < length; ++i) {
-            oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bytes[i]);
+    template <typename T>
+    bool BasicCBFFrame<T>::write(std::ostream& out, const std::string& name) const {
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+        // The size and MD5 fields come before the data, so the image is built first
+        if (!encode(name, m_scratch)) {
+            return false;
         }
-        return oss.str();
+        {
+            NANOCBF_STAGE(m_stats, Stage::Write, m_scratch.size());
+            out.write(reinterpret_cast<const char*>(m_scratch.data()), static_cast<std::streamsize>(m_scratch.size()));
+        }
+        m_scratch.clear();
+        return static_cast<bool>(out);
     }
 
-    std::string CBFFrame::bytesToBase64(const uint8_t* bytes, size_t length) {
-        const char* b64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-        std::string result;
+    template <typename T>
+    bool BasicCBFFrame<T>::encodePixels(const T* pixels, size_t count, const std::string& filename, std::vector<uint8_t>& out) const {
+        if (count == 0 || width == 0 || height == 0 || !enabledCompression(compression)) {
+            return false;
+        }
+        NANOCBF_STATS_CALL(m_stats, m_statsDepth);
+
+        bool hashing = integrity != IntegrityPolicy::None;
+        size_t sizeOffset, md5Offset;
+        std::string head = generateFileHead(filename, elementType(), hashing, sizeOffset, md5Offset);
+
+        // Size the image exactly, then compress straight into it
+        bool chunked = compression == Compression::ByteOffset;
+        size_t compressedSize;
+        {
+            NANOCBF_STAGE(m_stats, Stage::Compress, 0);
+            compressedSize = chunked ? byteOffsetEncodedSize(pixels, count) : wholeFrameMaxSize(count);
+        }
+        out.resize(head.size() + compressedSize + CBF_TAIL.size());
+        std::memcpy(out.data(), head.data(), head.size());
+        uint8_t* payload = out.data() + head.size();
+        size_t entryPixels = chunked ? rowIndexRows * static_cast<size_t>(width) : 0;
+        {
+            NANOCBF_STAGE(m_stats, Stage::Compress, count * sizeof(T));
+            if (!chunked) {
+                // Only the worst case is known up front; trim to the actual size
+                compressedSize = compressWholeFrame(pixels, count, payload);
+                out.resize(head.size() + compressedSize + CBF_TAIL.size());
+                payload = out.data() + head.size();
+            } else if (entryPixels == 0) {
+                encodeByteOffset(pixels, count, payload);
+            } else {
+                // Compress one index entry's rows at a time to learn where each starts
+                std::vector<ByteOffsetState> entries;
+                size_t position = 0;
+                for (size_t start = 0; start < count; start += entryPixels) {
+                    ByteOffsetState entry;
+                    entry.pos = position;
+                    entry.value = start > 0 ? static_cast<int32_t>(pixels[start - 1]) : 0;
+                    entries.push_back(entry);
+                    position += encodeByteOffset(pixels + start, std::min(entryPixels, count - start), payload + position, entry.value);
+                }
+                std::string indexItem = generateRowIndexItem(entries);
+                out.insert(out.end(), indexItem.begin(), indexItem.end());
+                payload = out.data() + head.size();
+            }
+            std::memcpy(payload + compressedSize, CBF_TAIL.data(), CBF_TAIL.size());
+        }
 
-        for (size_t i = 0; i < length; i += 3) {
-            uint32_t chunk = (bytes[i] << 16) |
-                            (i + 1 < length ? bytes[i + 1] << 8 : 0) |
-                            (i + 2 < length ? bytes[i + 2] : 0);
+        writeBinarySize(compressedSize, reinterpret_cast<char*>(out.data() + sizeOffset));
 
-            result += b64_chars[(chunk >> 18) & 0x3F];
-            result += b64_chars[(chunk >> 12) & 0x3F];
-            result += (i + 1 < length) ? b64_chars[(chunk >> 6) & 0x3F] : '=';
-            result += (i + 2 < length) ? b64_chars[chunk & 0x3F] : '=';
+        if (hashing) {
+            NANOCBF_STAGE(m_stats, Stage::Hash, compressedSize);
+            MD5State md5;
+            md5Update(md5, payload, compressedSize);
+            uint8_t digest[16];
+            md5Final(md5, digest);
+            writeBase64(digest, 16, reinterpret_cast<char*>(out.data() + md5Offset));
         }
 
-        return result;
+        return true;
     }
 
-    // MD5 round functions
-    #define F(x, y, z) ((x & y) | (~x & z))
-    #define G(x, y, z) ((x & z) | (y & ~z))
-    #define H(x, y, z) (x ^ y ^ z)
-    #define I(x, y, z) (y ^ (x | ~z))
 
-    // Rotate left
-    #define ROTLEFT(a, b) ((a << b) | (a >> (32 - b)))
+    // Case-insensitive comparison of [begin, end) with a MIME key
+    static bool keyEquals(const char* begin, const char* end, const char* key) {
+        size_t length = std::strlen(key);
+        if (static_cast<size_t>(end - begin) != length) return false;
+        for (size_t i = 0; i < length; ++i) {
+            if (std::tolower(static_cast<unsigned char>(begin[i])) != std::tolower(static_cast<unsigned char>(key[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    void CBFFrame::md5Transform(uint32_t state[4], const uint8_t block[64]) {
-        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
-        uint32_t x[16];
+    // Parse a decimal value; returns false if [begin, end) is not a number
+    // or does not fit in a size_t
+    static bool parseSize(const char* begin, const char* end, size_t& value) {
+        if (begin == end) return false;
+        const size_t maxValue = std::numeric_limits<size_t>::max();
+        value = 0;
+        for (const char* p = begin; p < end; ++p) {
+            if (*p < '0' || *p > '9') return false;
+            size_t digit = static_cast<size_t>(*p - '0');
+            if (value > (maxValue - digit) / 10) return false;
+            value = value * 10 + digit;
+        }
+        return true;
+    }
 
-        // Convert block to 32-bit words
-        for (int i = 0; i < 16; ++i) {
-            x[i] = block[i*4] | (block[i*4+1] << 8) | (block[i*4+2] << 16) | (block[i*4+3] << 24);
+    // Parse a decimal value that has to fit in an int
+    static bool parseInt(const char* begin, const char* end, int& value) {
+        size_t number;
+        if (!parseSize(begin, end, number) || number > static_cast<size_t>(std::numeric_limits<int>::max())) {
+            return false;
         }
+        value = static_cast<int>(number);
+        return true;
+    }
 
-        // MD5 round constants
-        static const uint32_t k[64] = {
-            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
-            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
-            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
-            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
-            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
-            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
-            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
-            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
-        };
+    // Assign [begin, end) to value without surrounding quotes
+    static void assignUnquoted(std::string& value, const char* begin, const char* end) {
+        if (end - begin >= 2 && *begin == '"' && *(end - 1) == '"') {
+            ++begin;
+            --end;
+        }
+        value.assign(begin, end);
+    }
 
-        static const int s[64] = {
-            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
-            5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
-            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
-            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    bool CBFFrameBase::parseBinaryInfo(const char* begin, const char* end, BinaryInfo& info) {
+        info.clear();
+        auto invalidValue = [this](const char* key) {
+            m_error = std::string("Invalid ") + key + " value in header";
+            return false;
         };
+        bool haveWidth = false, haveHeight = false, haveSize = false;
+
+        // One pass over "Key: value" lines; indented lines continue the previous value
+        const char* lineStart = begin;
+        bool inContentType = false;
+        while (lineStart < end) {
+            const char* lineEnd = lineStart;
+            while (lineEnd < end && *lineEnd != '\r' && *lineEnd != '\n') ++lineEnd;
+
+            const char* keyEnd = nullptr;
+            const char* valueStart = lineStart;
+            if (*lineStart != ' ' && *lineStart != '\t') {
+                keyEnd = static_cast<const char*>(std::memchr(lineStart, ':', lineEnd - lineStart));
+                valueStart = keyEnd ? keyEnd + 1 : lineEnd;
+                inContentType = false;
+            }
 
-        // MD5 main loop
-        for (int i = 0; i < 64; ++i) {
-            uint32_t f, g;
-
-            if (i < 16) {
-                f = F(b, c, d);
-                g = i;
-            } else if (i < 32) {
-                f = G(b, c, d);
-                g = (5 * i + 1) % 16;
-            } else if (i < 48) {
-                f = H(b, c, d);
-                g = (3 * i + 5) % 16;
-            } else {
-                f = I(b, c, d);
-                g = (7 * i) % 16;
+            // Trim the value
+            const char* valueEnd = lineEnd;
+            while (valueStart < valueEnd && std::isspace(static_cast<unsigned char>(*valueStart))) ++valueStart;
+            while (valueEnd > valueStart && std::isspace(static_cast<unsigned char>(*(valueEnd - 1)))) --valueEnd;
+
+            if (keyEnd) {
+                if (keyEquals(lineStart, keyEnd, "Content-Type")) {
+                    inContentType = true;
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Size-Fastest-Dimension")) {
+                    haveWidth = parseInt(valueStart, valueEnd, info.width);
+                    if (!haveWidth) return invalidValue("X-Binary-Size-Fastest-Dimension");
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Size-Second-Dimension")) {
+                    haveHeight = parseInt(valueStart, valueEnd, info.height);
+                    if (!haveHeight) return invalidValue("X-Binary-Size-Second-Dimension");
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Size-Padding")) {
+                    parseSize(valueStart, valueEnd, info.padding);
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Size")) {
+                    haveSize = parseSize(valueStart, valueEnd, info.size);
+                    if (!haveSize) return invalidValue("X-Binary-Size");
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-ID")) {
+                    parseInt(valueStart, valueEnd, info.id);
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Number-of-Elements")) {
+                    parseSize(valueStart, valueEnd, info.elementCount);
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Element-Type")) {
+                    assignUnquoted(info.elementType, valueStart, valueEnd);
+                } else if (keyEquals(lineStart, keyEnd, "X-Binary-Element-Byte-Order")) {
+                    info.byteOrder.assign(valueStart, valueEnd);
+                } else if (keyEquals(lineStart, keyEnd, "Content-MD5")) {
+                    info.contentMD5.assign(valueStart, valueEnd);
+                }
             }
 
-            f = f + a + k[i] + x[g];
-            a = d;
-            d = c;
-            c = b;
-            b = b + ROTLEFT(f, s[i]);
+            // conversions="..." is a Content-Type parameter, on its line or a continuation line
+            if (inContentType) {
+                const char* param = findMarker(valueStart, valueEnd, "conversions=");
+                if (param != valueEnd) {
+                    const char* paramStart = param + std::strlen("conversions=");
+                    const char* paramEnd = paramStart;
+                    while (paramEnd < valueEnd && *paramEnd != ';') ++paramEnd;
+                    assignUnquoted(info.conversions, paramStart, paramEnd);
+                }
+            }
+
+            lineStart = lineEnd;
+            while (lineStart < end && (*lineStart == '\r' || *lineStart == '\n')) ++lineStart;
+        }
+
+        if (!haveWidth) {
+            m_error = "Could not find width in header";
+            return false;
+        }
+        if (!haveHeight) {
+            m_error = "Could not find height in header";
+            return false;
+        }
+        if (!haveSize) {
+            m_error = "Could not find data size in header";
+            return false;
+        }
+
+        return true;
+    }
+
+    int CBFFrameBase::elementTypeBits(const std::string& type) {
+        // "signed 32-bit integer", "unsigned 16-bit integer", ...
+        size_t bitPos = type.find("-bit");
+        size_t digits = bitPos;
+        while (digits != std::string::npos && digits > 0 && std::isdigit(static_cast<unsigned char>(type[digits - 1]))) --digits;
+        if (bitPos == std::string::npos || digits == bitPos) {
+            return 0;
         }
+        return std::atoi(type.c_str() + digits);
+    }
 
-        state[0] += a;
-        state[1] += b;
-        state[2] += c;
-        state[3] += d;
+    bool CBFFrameBase::elementTypeUnsigned(const std::string& type) {
+        return type.find("unsigned") != std::string::npos;
+    }
+
+    bool CBFFrameBase::checkElementType(int pixelBits, bool pixelSigned) {
+        const std::string& type = binaryInfo.elementType;
+        int bits = elementTypeBits(type);
+        if (bits == 0) {
+            return true;
+        }
+        // Unsigned data also fits in a strictly wider signed pixel
+        bool isSigned = !elementTypeUnsigned(type);
+        bool fits = isSigned == pixelSigned ? bits <= pixelBits : !isSigned && bits < pixelBits;
+        if (!fits) {
+            m_error = "Element type \"" + type + "\" does not fit in " + (pixelSigned ? "signed " : "unsigned ") +
+                      std::to_string(pixelBits) + "-bit pixels";
+            return false;
+        }
+        return true;
     }
 
-    void CBFFrame::md5Update(uint32_t state[4], uint64_t& count, uint8_t buffer[64], const uint8_t* input, size_t length) {
-        size_t bufferIndex = count % 64;
-        count += length;
+    bool CBFFrameBase::checkCompression() {
+        if (!parseConversions(binaryInfo.conversions, m_payloadCompression)) {
+            m_error = "Unsupported conversions \"" + binaryInfo.conversions + "\"";
+            return false;
+        }
+        if (!enabledCompression(m_payloadCompression)) {
+            m_error = std::string(conversionsName(m_payloadCompression)) + " is not verified against CBFlib yet (build with NANOCBF_PACKED)";
+            return false;
+        }
+        if (m_payloadCompression == Compression::None && binaryInfo.byteOrder == "BIG_ENDIAN") {
+            m_error = "Unsupported byte order BIG_ENDIAN";
+            return false;
+        }
+        return true;
+    }
 
-        if (bufferIndex + length >= 64) {
-            size_t firstChunk = 64 - bufferIndex;
-            std::memcpy(buffer + bufferIndex, input, firstChunk);
-            md5Transform(state, buffer);
+    bool CBFFrameBase::checkByteOffset(const char* operation) {
+        if (m_payloadCompression != Compression::ByteOffset) {
+            m_error = std::string(operation) + " needs x-CBF_BYTE_OFFSET data, not " + conversionsName(m_payloadCompression);
+            return false;
+        }
+        return true;
+    }
 
-            for (size_t i = firstChunk; i + 64 <= length; i += 64) {
-                md5Transform(state, input + i);
+    template <typename T>
+    size_t BasicCBFFrame<T>::decompressData(const uint8_t* compressed, size_t size, T* out, size_t count) const {
+        switch (m_payloadCompression) {
+            case Compression::Packed:
+            case Compression::PackedV2:
+                return decodePacked(compressed, size, out, count, static_cast<size_t>(width), m_payloadCompression == Compression::PackedV2);
+            case Compression::None: {
+                // Without an element type the elements are as wide as the payload allows
+                int bits = elementTypeBits(binaryInfo.elementType);
+                size_t elementSize = bits > 0 ? static_cast<size_t>(bits) / 8 : (count > 0 ? size / count : 0);
+                bool isSigned = binaryInfo.elementType.empty() ? std::is_signed<T>::value : !elementTypeUnsigned(binaryInfo.elementType);
+                return decodeUncompressed(compressed, size, out, count, elementSize, isSigned);
             }
+            default:
+                break;
+        }
 
-            size_t remaining = length - ((length - firstChunk) / 64) * 64 - firstChunk;
-            std::memcpy(buffer, input + length - remaining, remaining);
-        } else {
-            std::memcpy(buffer + bufferIndex, input, length);
+        if (threads > 1 && count >= PARALLEL_DECODE_PIXELS) {
+            // A stored row index saves the pre-scan, unless it turns out not to match the data
+            size_t decoded;
+            if (rowIndex.rowsPerEntry > 0 &&
+                decodeByteOffsetIndexed(compressed, size, out, count, rowIndex.entries, rowIndex.rowsPerEntry * width, threads, decoded)) {
+                return decoded;
+            }
+            return decodeByteOffsetParallel(compressed, size, out, count, threads);
+        }
+
+        // A decoder registered for this geometry writes 32-bit pixels of the whole frame
+        if (sizeof(T) == sizeof(int32_t) && count == static_cast<size_t>(width) * height) {
+            ByteOffsetFrameDecoder decode = byteOffsetDecoderFor(static_cast<size_t>(width), static_cast<size_t>(height));
+            if (decode) {
+                return decode(compressed, size, reinterpret_cast<int32_t*>(out));
+            }
+        }
+
+        ByteOffsetState state;
+        return decodeByteOffset(compressed, size, state, out, count);
+    }
+
+    // Append the decimal digits of value
+    static void appendNumber(std::string& out, uint64_t value) {
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) {
+            out += digits[--count];
         }
     }
 
-    void CBFFrame::md5Final(uint8_t digest[16], uint32_t state[4], uint64_t count, uint8_t buffer[64]) {
-        size_t bufferIndex = count % 64;
-        buffer[bufferIndex++] = 0x80;
+    void CBFFrameBase::appendArrayDataSection(std::string& out, const char* elementType, bool withMD5,
+                                              size_t& sizeOffset, size_t& md5Offset) const {
+        out += "_array_data.data\r\n"
+               ";\r\n"
+               "--CIF-BINARY-FORMAT-SECTION--\r\n"
+               "Content-Type: application/octet-stream;\r\n"
+               "     conversions=\"";
+        out += conversionsName(compression);
+        out += "\"\r\n"
+               "Content-Transfer-Encoding: BINARY\r\n"
+               "X-Binary-Size: ";
+        sizeOffset = out.size();
+        out.append(BINARY_SIZE_WIDTH, ' ');
+        out += "\r\nX-Binary-ID: 1\r\n"
+               "X-Binary-Element-Type: \"";
+        out += elementType;
+        out += "\"\r\n"
+               "X-Binary-Element-Byte-Order: LITTLE_ENDIAN\r\n";
+        md5Offset = 0;
+        if (withMD5) {
+            out += "Content-MD5: ";
+            md5Offset = out.size();
+            out.append(MD5_BASE64_WIDTH, ' ');
+            out += "\r\n";
+        }
+        out += "X-Binary-Number-of-Elements: ";
+        appendNumber(out, static_cast<uint64_t>(width) * static_cast<uint64_t>(height));
+        out += "\r\nX-Binary-Size-Fastest-Dimension: ";
+        appendNumber(out, static_cast<uint64_t>(width));
+        out += "\r\nX-Binary-Size-Second-Dimension: ";
+        appendNumber(out, static_cast<uint64_t>(height));
+        out += "\r\nX-Binary-Size-Padding: 4095\r\n\r\n";
+        out.append(reinterpret_cast<const char*>(CBF_MAGIC.data()), CBF_MAGIC.size());
+    }
 
-        if (bufferIndex > 56) {
-            std::memset(buffer + bufferIndex, 0, 64 - bufferIndex);
-            md5Transform(state, buffer);
-            bufferIndex = 0;
+    std::string CBFFrameBase::generateFileHead(const std::string& filename, const char* elementType, bool withMD5,
+                                               size_t& sizeOffset, size_t& md5Offset) const {
+        // CBF prefix (version and data section name), then user header or default header if empty
+        std::string head;
+        appendCbfPrefix(head, filename);
+        head += headerText();
+        appendArrayDataSection(head, elementType, withMD5, sizeOffset, md5Offset);
+        return head;
+    }
+
+    void CBFFrameBase::writeBinarySize(size_t size, char* out) {
+        // Right-aligned in the BINARY_SIZE_WIDTH placeholder
+        for (int i = BINARY_SIZE_WIDTH - 1; i >= 0; --i) {
+            out[i] = size != 0 || i == BINARY_SIZE_WIDTH - 1 ? static_cast<char>('0' + size % 10) : ' ';
+            size /= 10;
         }
+    }
 
-        std::memset(buffer + bufferIndex, 0, 56 - bufferIndex);
+    void CBFFrameBase::appendCbfPrefix(std::string& out, const std::string& filename) const {
+        out += "###CBF: VERSION 1.5 generated by nanocbf\r\n"
+               "data_";
+        appendBaseName(out, filename);
+        out += "\r\n\r\n";
+    }
 
-        uint64_t bitCount = count * 8;
-        for (int i = 0; i < 8; ++i) {
-            buffer[56 + i] = (bitCount >> (i * 8)) & 0xFF;
+    const std::string& CBFFrameBase::headerText() const {
+        if (headerTemplate) {
+            return headerTemplate->text();
         }
+        return header.empty() ? DEFAULT_HEADER : header;
+    }
+
+    void CBFFrameBase::appendBaseName(std::string& out, const std::string& filepath) {
+        // Find last slash or backslash for directory separation
+        size_t lastSlash = filepath.find_last_of("/\\");
+        size_t begin = lastSlash == std::string::npos ? 0 : lastSlash + 1;
 
-        md5Transform(state, buffer);
+        // Remove .cbf extension if present
+        size_t end = filepath.size();
+        if (end - begin >= 4 && filepath.compare(end - 4, 4, ".cbf") == 0) {
+            end -= 4;
+        }
 
-        for (int i = 0; i < 4; ++i) {
-            digest[i*4]     = (state[i]) & 0xFF;
-            digest[i*4 + 1] = (state[i] >> 8) & 0xFF;
-            digest[i*4 + 2] = (state[i] >> 16) & 0xFF;
-            digest[i*4 + 3] = (state[i] >> 24) & 0xFF;
+        // Replace all whitespace characters with underscores
+        for (size_t i = begin; i < end; ++i) {
+            char c = filepath[i];
+            out += std::isspace(static_cast<unsigned char>(c)) ? '_' : c;
         }
     }
+
+    std::string CBFFrameBase::bytesToHex(const uint8_t* bytes, size_t length) {
+        std::ostringstream oss;
+        for (size_t i = 0; i < length; ++i) {
+            oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bytes[i]);
+        }
+        return oss.str();
+    }
+
+    std::string CBFFrameBase::bytesToBase64(const uint8_t* bytes, size_t length) {
+        std::string result(4 * ((length + 2) / 3), '\0');
+        writeBase64(bytes, length, &result[0]);
+        return result;
+    }
+
+    void CBFFrameBase::writeBase64(const uint8_t* bytes, size_t length, char* out) {
+        const char* b64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        for (size_t i = 0; i < length; i += 3) {
+            uint32_t chunk = (bytes[i] << 16) |
+                            (i + 1 < length ? bytes[i + 1] << 8 : 0) |
+                            (i + 2 < length ? bytes[i + 2] : 0);
+
+            *out++ = b64_chars[(chunk >> 18) & 0x3F];
+            *out++ = b64_chars[(chunk >> 12) & 0x3F];
+            *out++ = (i + 1 < length) ? b64_chars[(chunk >> 6) & 0x3F] : '=';
+            *out++ = (i + 2 < length) ? b64_chars[chunk & 0x3F] : '=';
+        }
+    }
+
+    template class BasicCBFFrame<int32_t>;
+    template class BasicCBFFrame<uint32_t>;
+    template class BasicCBFFrame<int16_t>;
+    template class BasicCBFFrame<uint16_t>;
 }
@@ -23,7 +23,6 @@
  */
 
 //TODO: width, height, headers -> interface?? just to be able to work with an interface later???
-//TODO: might be useful to just read headers without reding the data itself, thought not soooo important
 
 
 #ifndef CBFFRAME_H
@@ -32,72 +31,426 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <iosfwd>
+#include "byteoffset.h"
+#include "cbfheader.h"
+#include "compression.h"
+#include "filereader.h"
+#include "filewriter.h"
+#include "mappedfile.h"
+#include "stats.h"
 
 namespace nanocbf {
 
-class CBFFrame {
+struct MD5State;
+
+// Fields of the MIME header in front of the binary data
+struct BinaryInfo {
+    std::string conversions;    // Compression, e.g. x-CBF_BYTE_OFFSET
+    std::string elementType;    // e.g. signed 32-bit integer
+    std::string byteOrder;      // e.g. LITTLE_ENDIAN
+    std::string contentMD5;     // Base64 MD5 of the compressed data, empty if absent
+    size_t size;                // X-Binary-Size: compressed payload size in bytes
+    size_t elementCount;        // X-Binary-Number-of-Elements
+    size_t padding;             // X-Binary-Size-Padding, DEFAULT_PADDING if absent
+    int id;                     // X-Binary-ID
+    int width;                  // X-Binary-Size-Fastest-Dimension
+    int height;                 // X-Binary-Size-Second-Dimension
+
+    static const size_t DEFAULT_PADDING = 4095;
+
+    BinaryInfo() : size(0), elementCount(0), padding(DEFAULT_PADDING), id(0), width(0), height(0) {}
+
+    // Reset all fields, keeping the string buffers for the next frame
+    void clear() {
+        conversions.clear();
+        elementType.clear();
+        byteOrder.clear();
+        contentMD5.clear();
+        size = elementCount = 0;
+        padding = DEFAULT_PADDING;
+        id = width = height = 0;
+    }
+};
+
+// Where one binary section lies in a file image, found by
+// CBFFrameBase::findSections. Offsets are from the start of the image.
+struct BinarySection {
+    std::string blockName;      // Name of the data_ block holding the section
+    size_t headerBegin;         // Header text of the block is [headerBegin, headerEnd)
+    size_t headerEnd;
+    size_t payloadOffset;       // Compressed data, info.size bytes
+    size_t end;                 // End of the section's end marker
+    size_t limit;               // Where the next section's block or marker starts (or the image ends)
+    BinaryInfo info;
+
+    BinarySection() : headerBegin(0), headerEnd(0), payloadOffset(0), end(0), limit(0) {}
+};
+
+// Decoder states at the start of every rowsPerEntry-th row of a frame, so row
+// ranges can be decoded without first decoding the rows in front of them.
+// Stored after the binary section as a CIF item that other readers ignore.
+struct RowIndex {
+    size_t rowsPerEntry;                    // 0 if there is no index
+    std::vector<ByteOffsetState> entries;   // entries[k] is the state at row k * rowsPerEntry
+
+    RowIndex() : rowsPerEntry(0) {}
+
+    void clear() {
+        rowsPerEntry = 0;
+        entries.clear();
+    }
+};
+
+// How the Content-MD5 digest of the binary data is handled
+enum class IntegrityPolicy {
+    Compute,    // Compute on write, ignore on read (default)
+    None,       // Skip the hash on write (no Content-MD5 is written), ignore on read
+    Verify,     // Compute on write, check while decoding on read if the file has one
+    Async       // Compute on write on a worker thread alongside compression
+};
+
+// Header, geometry and binary section handling shared by frames of every
+// pixel type. Use CBFFrame (or another BasicCBFFrame) rather than this class.
+class CBFFrameBase {
 public:
-    CBFFrame();
-    explicit CBFFrame(const std::string &filename);
-    ~CBFFrame();
-    
-    // Read CBF file
-    bool read(const std::string& filename);
-    
-    // Write CBF file
-    bool write(const std::string& filename) const;
-    
+    // Read only header, width, height and binaryInfo; the compressed payload
+    // is never read from disk
+    bool readHeader(const std::string& filename);
+
+    // Read CBF file, decoding only region (see DecodeRegion) into out, which
+    // holds capacity pixels. Rows after the region are not decoded at all.
+    // Content-MD5 is never checked, since the data is only partly decoded.
+    // Only x-CBF_BYTE_OFFSET data is supported.
+    bool readRegion(const std::string& filename, const DecodeRegion& region, int32_t* out, size_t capacity);
+
+    // Key/value index of header (see HeaderIndex), built on first use after
+    // each read and whenever header has been replaced by one of a different
+    // length. Re-index after editing header in place with headerIndex().build(header).
+    HeaderIndex& headerIndex();
+
+    // Index every binary section of a complete file image in one pass, e.g.
+    // frames concatenated into one archive file or several X-Binary-IDs in
+    // a data block. Sections in the same data block share its header.
+    bool findSections(const uint8_t* image, size_t size, std::vector<BinarySection>& sections);
+
     // Get error message
     const std::string& getError() const { return m_error; }
-    
+
+    // Time and bytes per stage of the last read, decode, write or encode call
+    // (see Stats; all 0 unless the library is built with NANOCBF_STATS)
+    const Stats& stats() const { return m_stats; }
+
     // Public accessible fields
     std::string header;         // User-provided header content (everything after data_filename section)
-    std::vector<int32_t> data;  // 1D vector of pixel data
     int width;
     int height;
-    
-private:
+    BinaryInfo binaryInfo;      // Binary section fields of the last frame read
+    IntegrityPolicy integrity;  // Content-MD5 handling for read and write
+    unsigned threads;           // Threads used by read to decode frames of at least PARALLEL_DECODE_PIXELS pixels
+    size_t rowIndexRows;        // Rows between the row index entries written by write and encode; 0 writes no index
+    Compression compression;    // Compression used by write and encode; read follows the file's conversions
+    bool preallocate;           // Reserve the file's size before write fills it (fallocate on Linux)
+    SyncPolicy sync;            // Whether write waits for the file to reach the disk
+    IOBackend io;               // How the read calls and readRegion load files: Mapped (default) maps them, Blocking
+                                // and IoUring read them through a FileReader into a reused buffer; open() always maps
+    bool directIO;              // Open files with O_DIRECT where the filesystem allows it, if io is not Mapped
+    const HeaderTemplate* headerTemplate; // Header text for write and encode instead of header if set
+    RowIndex rowIndex;          // Row index of the last frame read, empty if it has none
+
+    static const size_t PARALLEL_DECODE_PIXELS = 1 << 20;
+
+protected:
+    CBFFrameBase();
+
     static const std::vector<uint8_t> CBF_MAGIC;
     static const std::string CBF_TAIL;
-    
+    static const std::string DEFAULT_HEADER;
+    static const size_t HEADER_READ_SIZE = 16384;  // First chunk read by readHeader
+    static const size_t MAX_HEADER_READ_SIZE = 1 << 20;  // readHeader gives up past this
+    static const size_t WRITE_CHUNK_PIXELS = 16384; // Pixels compressed and hashed at a time by write
+    static const int BINARY_SIZE_WIDTH = 12;        // Fixed width of the X-Binary-Size value
+    static const int MD5_BASE64_WIDTH = 24;         // Length of a base64 encoded MD5 digest
+    static const size_t VERIFY_BLOCK_SIZE = 65536;  // Payload bytes hashed then decoded at a time
+    static const size_t END_MARKER_SLACK = 4096;    // Bytes besides the padding searched for the end marker
+
+    // Whether read, write and encode handle compression. The packed codec has
+    // not been checked against CBFlib files yet, so it is only available when
+    // the library is built with NANOCBF_PACKED
+    static bool enabledCompression(Compression compression) {
+#ifdef NANOCBF_PACKED
+        (void)compression;
+        return true;
+#else
+        return compression == Compression::ByteOffset || compression == Compression::None;
+#endif
+    }
+
     std::string m_error;
+    mutable std::vector<uint8_t> m_scratch; // Reused by read, readHeader and write; always left empty
+    mutable std::string m_head;             // Prefix and binary section of the file being written
+    mutable Stats m_stats;                  // Stages of the current or last call
+    mutable int m_statsDepth;               // Nesting of the calls recording into m_stats
+
+    // FileReader used when io is not Mapped. Readers are not thread-safe, so
+    // a copy of a frame gets its own
+    struct FileReaderCache {
+        std::unique_ptr<FileReader> reader;
+        IOBackend backend;
+        bool direct;
+        FileRequest request;    // The file last read; its buffer is reused
+
+        FileReaderCache() : backend(IOBackend::Mapped), direct(false) {}
+        FileReaderCache(const FileReaderCache&) : backend(IOBackend::Mapped), direct(false) {}
+        FileReaderCache(FileReaderCache&&) = default;
+        FileReaderCache& operator=(const FileReaderCache&) { return *this; }
+        FileReaderCache& operator=(FileReaderCache&&) = default;
+    };
+    FileReaderCache m_reader;
+
+    // File mapped by open() whose payload has not been decoded yet
+    std::shared_ptr<MappedFile> m_pendingFile;
+    size_t m_pendingOffset;
+    size_t m_pendingSize;
+
+    // Compression of the payload located by openFrame
+    Compression m_payloadCompression;
+
+    // Index of header, valid while m_headerIndexed is set
+    HeaderIndex m_headerIndex;
+    bool m_headerIndexed;
+
+    // Empty header and binaryInfo, keeping their buffers
+    void clearFields();
+
+    // Find the next CBF magic number in [from, end), or end. Text never
+    // contains it, so the text in front of a binary section ends there;
+    // bounding marker searches by it keeps a missing marker from costing a
+    // scan of the payload.
+    static const char* findMagic(const char* from, const char* end);
+
+    // Find the end marker of a section, which follows the payload within its
+    // padding (plus END_MARKER_SLACK), so it is never looked for further away;
+    // returns fileEnd if it is missing
+    static const char* findSectionEnd(const char* payloadEnd, const char* fileEnd, size_t padding);
+
+    // Parse header and binary section MIME block from the start of a file;
+    // payloadOffset is where the compressed data begins
+    bool parseHeader(const uint8_t* fileData, size_t fileSize, size_t& payloadOffset);
+
+    // Locate header, dimensions and compressed payload in a complete file image
+    bool parseFrame(const uint8_t* fileData, size_t fileSize, const uint8_t*& payload, size_t& payloadSize);
+
+    // Parse the binary section MIME block in [begin, end)
+    bool parseBinaryInfo(const char* begin, const char* end, BinaryInfo& info);
+
+    // Parse the row index item in [begin, end), the text after the binary
+    // section; an index that does not fit the frame is ignored
+    void parseRowIndex(const char* begin, const char* end, size_t payloadSize);
+
+    // Generate the row index item for entries taken every rowIndexRows rows
+    std::string generateRowIndexItem(const std::vector<ByteOffsetState>& entries) const;
+
+    // Load a whole file as io says, into file if it is mapped (or always, with
+    // mapOnly) with the given access hint; image stays valid until file is
+    // closed or the next load
+    bool loadFile(MappedFile& file, const std::string& filename, FileAccess access, bool mapOnly,
+                  const uint8_t*& image, size_t& size);
+
+    // Load a file and locate its compressed payload; fails for element types
+    // that do not fit in pixelBits-bit pixels of the given signedness
+    bool openFrame(MappedFile& file, const std::string& filename, int pixelBits, bool pixelSigned,
+                   const uint8_t*& payload, size_t& payloadSize, FileAccess access, bool mapOnly = false);
+
+    // Access hint for decoding a whole payload: front to back on one thread,
+    // or chunks of it at once on several
+    FileAccess decodeAccess() const { return threads > 1 ? FileAccess::Normal : FileAccess::Sequential; }
+
+    // Locate the compressed payload in a complete file image, like openFrame
+    bool locateFrame(const uint8_t* image, size_t size, int pixelBits, bool pixelSigned, const uint8_t*& payload,
+                     size_t& payloadSize);
+
+    // Take header, binaryInfo and the row index from a section found by
+    // findSections in image, like locateFrame
+    bool locateSection(const uint8_t* image, size_t size, const BinarySection& section, int pixelBits, bool pixelSigned,
+                       const uint8_t*& payload, size_t& payloadSize);
+
+    // Fail unless width * height pixels fit in capacity
+    bool checkCapacity(size_t capacity);
+
+    // Fail unless all width * height pixels were decoded
+    bool checkDecoded(size_t decoded);
+
+    // Finish md5 and compare it with the Content-MD5 of the file
+    bool verifyContentMD5(MD5State& md5);
+
+    // Fail unless the element type of the binary section fits in pixelBits-bit
+    // pixels of the given signedness: same signedness and no wider, or unsigned
+    // data in strictly wider signed pixels. An absent or unrecognized element
+    // type is accepted
+    bool checkElementType(int pixelBits, bool pixelSigned);
+
+    // Set m_payloadCompression from binaryInfo; fails for unsupported conversions
+    bool checkCompression();
+
+    // Fail unless the payload is x-CBF_BYTE_OFFSET; operation names the caller
+    bool checkByteOffset(const char* operation);
+
+    // Bits per element of an "...-bit integer" element type, or 0 if unknown
+    static int elementTypeBits(const std::string& type);
+
+    // Whether an element type names unsigned integers
+    static bool elementTypeUnsigned(const std::string& type);
+
+    // Append the _array_data.data section, with blank fixed-width fields for
+    // X-Binary-Size and (if withMD5) Content-MD5 at the returned offsets into
+    // out, up to and including the magic number
+    void appendArrayDataSection(std::string& out, const char* elementType, bool withMD5,
+                                size_t& sizeOffset, size_t& md5Offset) const;
+
+    // Generate everything in front of the compressed data (prefix, header,
+    // binary section and magic number); offsets are from the start of the file
+    std::string generateFileHead(const std::string& filename, const char* elementType, bool withMD5,
+                                 size_t& sizeOffset, size_t& md5Offset) const;
+
+    // Fill the BINARY_SIZE_WIDTH characters of the X-Binary-Size placeholder at out
+    static void writeBinarySize(size_t size, char* out);
+
+    // Append CBF header prefix with version and data section name
+    void appendCbfPrefix(std::string& out, const std::string& filename) const;
+
+    // Header text written by write and encode: the template's, header, or
+    // DEFAULT_HEADER if both are empty
+    const std::string& headerText() const;
+
+    // Append filename without extension and path, whitespace replaced by '_'
+    static void appendBaseName(std::string& out, const std::string& filepath);
+
+    // Digest encoding helpers
+    static std::string bytesToHex(const uint8_t* bytes, size_t length);
+    static std::string bytesToBase64(const uint8_t* bytes, size_t length);
+    // Base64 encode into out, which must hold 4 * ((length + 2) / 3) characters
+    static void writeBase64(const uint8_t* bytes, size_t length, char* out);
+};
+
+// A frame with pixels of type T: int32_t, uint32_t, int16_t or uint16_t.
+// Files are written with the matching X-Binary-Element-Type, and read() fails
+// for files whose element type is wider than T.
+template <typename T>
+class BasicCBFFrame : public CBFFrameBase {
+public:
+    typedef T value_type;
+
+    BasicCBFFrame();
+    // Read filename, or with lazy just open() it
+    explicit BasicCBFFrame(const std::string &filename, bool lazy = false);
+    // Decode a CBF file image held in memory (see decode)
+    BasicCBFFrame(const uint8_t* image, size_t size);
+    ~BasicCBFFrame();
+
+    // Frames are copyable; moving hands over the pixel buffer without copying
+    BasicCBFFrame(const BasicCBFFrame&) = default;
+    BasicCBFFrame(BasicCBFFrame&&) = default;
+    BasicCBFFrame& operator=(const BasicCBFFrame&) = default;
+    BasicCBFFrame& operator=(BasicCBFFrame&&) = default;
     
-    // Binary data compression/decompression
-    std::vector<uint8_t> compressData(const std::vector<int32_t>& data) const;
-    std::vector<int32_t> decompressData(const std::vector<uint8_t>& compressed, int width, int height) const;
-    
-    // Utility functions
-    void writeInt16LE(std::vector<uint8_t>& buffer, int16_t value) const;
-    void writeInt32LE(std::vector<uint8_t>& buffer, int32_t value) const;
-    uint16_t readInt16LE(const uint8_t* buffer) const;
-    uint32_t readInt32LE(const uint8_t* buffer) const;
-    
-    // Parse binary header info from text header
-    bool parseBinaryInfo(const std::string& header, int& width, int& height, int& dataSize);
-    
-    // Generate the _array_data.data section with binary metadata
-    std::string generateArrayDataSection(const std::vector<uint8_t>& compressedData) const;
-    
-    // Generate CBF header prefix with version and data section name
-    std::string generateCbfPrefix(const std::string& filename) const;
-    
-    // Generate minimal default header if user header is empty
-    std::string generateDefaultHeader() const;
+    // Read CBF file
+    bool read(const std::string& filename);
+
+    // Decode a complete CBF file image held in memory, e.g. one read by a
+    // FileReader; image is not referred to afterwards. Like read, this takes
+    // the first binary section of the image.
+    bool decode(const uint8_t* image, size_t size);
+
+    // Decode the binary section of image found by findSections
+    bool decode(const uint8_t* image, size_t size, const BinarySection& section);
+
+    // Read CBF file, decoding the pixels into out instead of data. Fails if the
+    // frame has more than capacity pixels or the binary data is incomplete.
+    bool read(const std::string& filename, T* out, size_t capacity);
+
+    // Read CBF file, decoding the pixels straight to float with gain, offset
+    // and mask applied (see PixelCorrection), so no integer frame is stored.
+    // Only x-CBF_BYTE_OFFSET data is supported; unsigned 32-bit data converts
+    // as unsigned (correction.rawUnsigned is also set by the element type).
+    bool read(const std::string& filename, float* out, size_t capacity, const PixelCorrection& correction);
+
+    // Read only header, width, height and binaryInfo; the compressed payload is
+    // never read from disk and data is left empty
+    bool readHeader(const std::string& filename);
+
+    // Map the file and parse everything but the pixels, which pixels() decodes
+    // on first use. data stays empty until then, so call pixels() before
+    // write(). The file stays mapped until the pixels are decoded.
+    bool open(const std::string& filename);
+
+    // Pixels of the frame, decoding them first if the frame was opened lazily.
+    // If decoding fails the result is short or empty and getError() says why.
+    const std::vector<T>& pixels();
     
-    // Extract filename without extension and path
-    std::string extractBaseName(const std::string& filepath) const;
+    // Write CBF file with a single gather write once the data is compressed.
+    // Uses the frame's scratch buffer, so a frame must not be written from
+    // two threads at once.
+    bool write(const std::string& filename) const;
+
+    // Build the complete file image that write(filename) would produce in out
+    bool encode(const std::string& filename, std::vector<uint8_t>& out) const;
+
+    // Build the file image of width * height pixels taken from pixels rather
+    // than data, so a frame that lives elsewhere need not be copied
+    bool encode(const T* pixels, const std::string& filename, std::vector<uint8_t>& out) const;
+
+    // Write the file image to out; name fills in the data_ block name the way
+    // a filename does. Uses the scratch buffer, like write(filename).
+    bool write(std::ostream& out, const std::string& name = "image") const;
+
+    // Empty header, data and binaryInfo, keeping their buffers for the next read
+    void clear();
     
-    // Generate MD5 hash
-    std::string generateMD5(const std::vector<uint8_t>& data) const;
+    std::vector<T> data;        // 1D vector of pixel data
+
+    // X-Binary-Element-Type written for T
+    static const char* elementType();
     
-    // MD5 implementation helper functions
-    static std::string bytesToHex(const uint8_t* bytes, size_t length);
-    static std::string bytesToBase64(const uint8_t* bytes, size_t length);
-    static void md5Transform(uint32_t state[4], const uint8_t block[64]);
-    static void md5Update(uint32_t state[4], uint64_t& count, uint8_t buffer[64], const uint8_t* input, size_t length);
-    static void md5Final(uint8_t digest[16], uint32_t state[4], uint64_t count, uint8_t buffer[64]);
+private:
+    // Decode up to count pixels into out; returns the number of pixels decoded
+    size_t decompressData(const uint8_t* compressed, size_t size, T* out, size_t count) const;
+
+    // Decode the payload, checking Content-MD5 on the way if integrity is Verify
+    bool decodePayload(const uint8_t* payload, size_t size, T* out, size_t count, size_t& decoded);
+
+    // Decode a located payload into data
+    bool decodeInto(const uint8_t* payload, size_t size);
+
+    // Compress count pixels in one piece with compression, which must not be
+    // ByteOffset (streamed in chunks instead), into out, which must hold
+    // wholeFrameMaxSize(count) bytes. Returns the compressed size.
+    size_t compressWholeFrame(const T* pixels, size_t count, uint8_t* out) const;
+    size_t wholeFrameMaxSize(size_t count) const;
+
+    // Build the file image of count pixels starting at pixels
+    bool encodePixels(const T* pixels, size_t count, const std::string& filename, std::vector<uint8_t>& out) const;
 };
 
+typedef BasicCBFFrame<int32_t> CBFFrame;
+typedef BasicCBFFrame<uint32_t> CBFFrameU32;
+typedef BasicCBFFrame<int16_t> CBFFrameI16;
+typedef BasicCBFFrame<uint16_t> CBFFrameU16;
+
+// Complete CBF file image of width x height pixels with header (empty for the
+// default one), e.g. to send over the network; empty if width or height is 0
+template <typename T>
+std::vector<uint8_t> encodeCBF(const T* pixels, int width, int height, const std::string& header = std::string()) {
+    BasicCBFFrame<T> frame;
+    frame.width = width;
+    frame.height = height;
+    frame.header = header;
+    std::vector<uint8_t> image;
+    frame.encode(pixels, "image", image);
+    return image;
+}
+
 } // namespace nanocbf
 
 #endif // CBFFRAME_H
\ No newline at end of file
@@ -0,0 +1,275 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cbfheader.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace nanocbf {
+
+    namespace {
+
+    bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    const char* trimEnd(const char* begin, const char* end) {
+        while (end > begin && isBlank(end[-1])) {
+            --end;
+        }
+        return end;
+    }
+
+    const char* tokenEnd(const char* p, const char* end) {
+        while (p < end && !isBlank(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    // Key of the date line PILATUS writes as "# 2024-07-09T15:30:00.000"
+    const char TIMESTAMP_KEY[] = "Timestamp";
+
+    } // namespace
+
+    double StringRef::toDouble(double fallback) const {
+        // strtod needs a terminated string, and numbers are short
+        char buffer[64];
+        size_t length = size < sizeof(buffer) - 1 ? size : sizeof(buffer) - 1;
+        std::memcpy(buffer, data, length);
+        buffer[length] = '\0';
+
+        char* parsedEnd;
+        double result = std::strtod(buffer, &parsedEnd);
+        return parsedEnd == buffer ? fallback : result;
+    }
+
+    bool StringRef::operator==(const StringRef& other) const {
+        return size == other.size && (size == 0 || std::memcmp(data, other.data, size) == 0);
+    }
+
+    size_t StringRefHash::operator()(const StringRef& s) const {
+        // FNV-1a
+        size_t hash = static_cast<size_t>(14695981039346656037ULL);
+        for (size_t i = 0; i < s.size; ++i) {
+            hash ^= static_cast<unsigned char>(s.data[i]);
+            hash *= static_cast<size_t>(1099511628211ULL);
+        }
+        return hash;
+    }
+
+    void HeaderIndex::clear() {
+        m_entries.clear();
+        m_lookup.clear();
+        m_source = nullptr;
+        m_sourceSize = 0;
+    }
+
+    void HeaderIndex::add(StringRef key, StringRef value) {
+        Entry entry;
+        entry.key = key;
+        entry.value = value;
+        m_lookup.insert(std::make_pair(key, m_entries.size()));
+        m_entries.push_back(entry);
+    }
+
+    void HeaderIndex::build(const char* text, size_t size) {
+        clear();
+        m_source = text;
+        m_sourceSize = size;
+
+        const char* end = text + size;
+        StringRef pendingKey;           // CIF item whose value did not follow on its line
+        const char* fieldStart = nullptr; // Inside a ;-delimited text field if set
+
+        for (const char* line = text; line < end;) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            const char* next = lineEnd < end ? lineEnd + 1 : end;
+            const char* contentEnd = trimEnd(line, lineEnd);
+
+            if (*line == ';') {
+                if (fieldStart) {
+                    // Closing delimiter; the line break in front of it is not part of the value
+                    const char* valueEnd = line;
+                    if (valueEnd > fieldStart && valueEnd[-1] == '\n') {
+                        --valueEnd;
+                    }
+                    if (valueEnd > fieldStart && valueEnd[-1] == '\r') {
+                        --valueEnd;
+                    }
+                    add(pendingKey, StringRef(fieldStart, valueEnd - fieldStart));
+                    pendingKey = StringRef();
+                    fieldStart = nullptr;
+                } else if (!pendingKey.empty()) {
+                    // Opening delimiter; the value starts on the next line unless text follows the ';'
+                    fieldStart = skipBlanks(line + 1, lineEnd) == lineEnd ? next : line + 1;
+                }
+            } else if (*line == '#') {
+                // PILATUS "# Key value", "# Key: value" or "# Key = value"
+                const char* keyBegin = skipBlanks(line + 1, contentEnd);
+                const char* keyEnd = tokenEnd(keyBegin, contentEnd);
+                const char* valueBegin = skipBlanks(keyEnd, contentEnd);
+                if (keyEnd > keyBegin && (keyEnd[-1] == ':' || keyEnd[-1] == '=')) {
+                    --keyEnd;
+                } else if (valueBegin < contentEnd && (*valueBegin == ':' || *valueBegin == '=')) {
+                    valueBegin = skipBlanks(valueBegin + 1, contentEnd);
+                }
+
+                if (keyEnd > keyBegin && *keyBegin >= '0' && *keyBegin <= '9') {
+                    add(StringRef(TIMESTAMP_KEY, sizeof(TIMESTAMP_KEY) - 1), StringRef(keyBegin, contentEnd - keyBegin));
+                } else if (keyEnd > keyBegin) {
+                    add(StringRef(keyBegin, keyEnd - keyBegin), StringRef(valueBegin, contentEnd - valueBegin));
+                }
+            } else if (*line == '_' && !fieldStart) {
+                if (!pendingKey.empty()) {
+                    add(pendingKey, StringRef());
+                }
+                const char* keyEnd = tokenEnd(line, contentEnd);
+                const char* valueBegin = skipBlanks(keyEnd, contentEnd);
+                const char* valueEnd = contentEnd;
+                if (valueEnd - valueBegin >= 2 && (*valueBegin == '"' || *valueBegin == '\'') && valueEnd[-1] == *valueBegin) {
+                    ++valueBegin;
+                    --valueEnd;
+                }
+
+                pendingKey = StringRef();
+                if (valueBegin == contentEnd) {
+                    pendingKey = StringRef(line, keyEnd - line);
+                } else {
+                    add(StringRef(line, keyEnd - line), StringRef(valueBegin, valueEnd - valueBegin));
+                }
+            } else if (!fieldStart && !pendingKey.empty() && contentEnd > line) {
+                // Anything but a text field after an item without a value
+                add(pendingKey, StringRef());
+                pendingKey = StringRef();
+            }
+
+            line = next;
+        }
+
+        if (!pendingKey.empty()) {
+            add(pendingKey, fieldStart ? StringRef(fieldStart, end - fieldStart) : StringRef());
+        }
+    }
+
+    bool HeaderIndex::find(StringRef key, StringRef& value) const {
+        std::unordered_map<StringRef, size_t, StringRefHash>::const_iterator it = m_lookup.find(key);
+        if (it == m_lookup.end()) {
+            return false;
+        }
+        value = m_entries[it->second].value;
+        return true;
+    }
+
+    StringRef HeaderIndex::value(StringRef key) const {
+        StringRef result;
+        find(key, result);
+        return result;
+    }
+
+    double HeaderIndex::number(StringRef key, double fallback) const {
+        StringRef result;
+        return find(key, result) ? result.toDouble(fallback) : fallback;
+    }
+
+    bool HeaderTemplate::compile(const std::string& pattern) {
+        m_text.clear();
+        m_slots.clear();
+        m_error.clear();
+
+        size_t position = 0;
+        while (true) {
+            size_t open = pattern.find("${", position);
+            m_text.append(pattern, position, open == std::string::npos ? std::string::npos : open - position);
+            if (open == std::string::npos) {
+                return true;
+            }
+
+            size_t close = pattern.find('}', open);
+            size_t colon = pattern.find(':', open);
+            if (close == std::string::npos || colon > close || colon == open + 2) {
+                m_error = "Malformed header template slot at offset " + std::to_string(open);
+                return false;
+            }
+
+            std::string widthText = pattern.substr(colon + 1, close - colon - 1);
+            char* widthEnd;
+            unsigned long width = std::strtoul(widthText.c_str(), &widthEnd, 10);
+            if (widthText.empty() || *widthEnd != '\0' || width == 0) {
+                m_error = "Invalid width in header template slot at offset " + std::to_string(open);
+                return false;
+            }
+
+            Slot entry;
+            entry.name = pattern.substr(open + 2, colon - open - 2);
+            entry.offset = m_text.size();
+            entry.width = width;
+            m_slots.push_back(entry);
+            m_text.append(width, ' ');
+            position = close + 1;
+        }
+    }
+
+    int HeaderTemplate::slot(const std::string& name) const {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    bool HeaderTemplate::set(int slot, const char* value, size_t length) {
+        if (slot < 0 || static_cast<size_t>(slot) >= m_slots.size() || length > m_slots[slot].width) {
+            return false;
+        }
+        char* out = &m_text[m_slots[slot].offset];
+        std::memcpy(out, value, length);
+        std::memset(out + length, ' ', m_slots[slot].width - length);
+        return true;
+    }
+
+    bool HeaderTemplate::set(int slot, long long value) {
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), "%lld", value);
+        return length > 0 && set(slot, buffer, static_cast<size_t>(length));
+    }
+
+    bool HeaderTemplate::set(int slot, double value, int precision) {
+        char buffer[64];
+        int length = std::snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+        return length > 0 && static_cast<size_t>(length) < sizeof(buffer) && set(slot, buffer, static_cast<size_t>(length));
+    }
+}
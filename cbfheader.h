@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CBFHEADER_H
+#define CBFHEADER_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <unordered_map>
+
+namespace nanocbf {
+
+// Characters in a buffer owned by someone else (std::string_view is C++17)
+struct StringRef {
+    const char* data;
+    size_t size;
+
+    StringRef() : data(nullptr), size(0) {}
+    StringRef(const char* d, size_t n) : data(d), size(n) {}
+    StringRef(const char* s) : data(s), size(std::strlen(s)) {}
+    StringRef(const std::string& s) : data(s.data()), size(s.size()) {}
+
+    bool empty() const { return size == 0; }
+    std::string str() const { return std::string(data, size); }
+
+    // Leading number of the value, e.g. 0.1 for "0.1000 deg."; fallback if
+    // it does not start with one
+    double toDouble(double fallback = 0.0) const;
+
+    bool operator==(const StringRef& other) const;
+    bool operator!=(const StringRef& other) const { return !(*this == other); }
+};
+
+struct StringRefHash {
+    size_t operator()(const StringRef& s) const;
+};
+
+// Key/value index of a CBF header, built in one pass over the text. Keys are
+// PILATUS "# Key value" lines inside header_contents (without the "# " and a
+// trailing ':' or '=', e.g. "Exposure_time") and CIF items (e.g.
+// "_array_data.header_convention", quotes removed; a ;-delimited text field
+// is its value without the delimiters). Keys and values point into the
+// indexed text, which must outlive the index and stay unchanged.
+class HeaderIndex {
+public:
+    struct Entry {
+        StringRef key;
+        StringRef value;
+    };
+
+    HeaderIndex() : m_source(nullptr), m_sourceSize(0) {}
+
+    // Index text, replacing the previous entries
+    void build(const char* text, size_t size);
+    void build(const std::string& text) { build(text.data(), text.size()); }
+    void clear();
+
+    // Value of key; the first one wins if a key appears more than once
+    bool find(StringRef key, StringRef& value) const;
+    bool contains(StringRef key) const { return m_lookup.count(key) != 0; }
+
+    // Value of key, empty if it is missing
+    StringRef value(StringRef key) const;
+
+    // Leading number of the value of key, fallback if it is missing or not a number
+    double number(StringRef key, double fallback = 0.0) const;
+
+    // All entries in header order
+    const std::vector<Entry>& entries() const { return m_entries; }
+    size_t size() const { return m_entries.size(); }
+
+    // Text the index was built from
+    const char* source() const { return m_source; }
+    size_t sourceSize() const { return m_sourceSize; }
+
+private:
+    void add(StringRef key, StringRef value);
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<StringRef, size_t, StringRefHash> m_lookup;  // Key to entry
+    const char* m_source;
+    size_t m_sourceSize;
+};
+
+// Header text with fixed-width slots that are patched in place, so a series
+// can change Start_angle, a timestamp or a frame number per frame without
+// rebuilding the header. Slots are written as ${name:width} in the pattern,
+// e.g. "# Start_angle ${angle:10} deg.", and hold width characters; values
+// are left-aligned and padded with spaces.
+class HeaderTemplate {
+public:
+    HeaderTemplate() {}
+    explicit HeaderTemplate(const std::string& pattern) { compile(pattern); }
+
+    // Replace the template; false (see getError) for a malformed slot
+    bool compile(const std::string& pattern);
+
+    // Slot number of name, -1 if there is none
+    int slot(const std::string& name) const;
+
+    // Fill a slot; false if the slot does not exist or the value does not fit
+    bool set(int slot, const char* value, size_t length);
+    bool set(int slot, const std::string& value) { return set(slot, value.data(), value.size()); }
+    bool set(int slot, long long value);
+    bool set(int slot, double value, int precision = 4);
+
+    // Any other integer type goes to the long long overload; without this an
+    // int would be ambiguous with the double one
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, bool>::type set(int slot, T value) {
+        return set(slot, static_cast<long long>(value));
+    }
+
+    // Header text with the current slot values
+    const std::string& text() const { return m_text; }
+    size_t slotCount() const { return m_slots.size(); }
+
+    const std::string& getError() const { return m_error; }
+
+private:
+    struct Slot {
+        std::string name;
+        size_t offset;
+        size_t width;
+    };
+
+    std::string m_text;
+    std::vector<Slot> m_slots;
+    std::string m_error;
+};
+
+} // namespace nanocbf
+
+#endif // CBFHEADER_H
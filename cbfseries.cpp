@@ -0,0 +1,170 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cbfseries.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace nanocbf {
+
+    CBFSeries::CBFSeries(const std::vector<std::string>& filenames, unsigned threads, size_t prefetch, IOBackend io, bool direct)
+        : m_filenames(filenames), m_slots(std::max<size_t>(prefetch, 1)), m_next(0), m_claimed(0),
+          m_io(io), m_direct(direct), m_batch(1), m_stop(false) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned>(std::min<size_t>(threads, m_slots.size()));
+        if (io != IOBackend::Mapped) {
+            m_batch = m_slots.size() / threads;
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            m_workers.push_back(std::thread(&CBFSeries::run, this));
+        }
+    }
+
+    CBFSeries::~CBFSeries() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_changed.notify_all();
+        }
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_workers[i].join();
+        }
+    }
+
+    std::vector<std::string> CBFSeries::expandTemplate(const std::string& pattern, int first, int last) {
+        std::vector<std::string> filenames;
+
+        size_t digitsStart = pattern.rfind('?');
+        if (digitsStart == std::string::npos) {
+            return filenames;
+        }
+        size_t digitsEnd = digitsStart + 1;
+        while (digitsStart > 0 && pattern[digitsStart - 1] == '?') {
+            --digitsStart;
+        }
+
+        for (int number = first; number <= last; ++number) {
+            std::ostringstream oss;
+            oss << pattern.substr(0, digitsStart)
+                << std::setw(static_cast<int>(digitsEnd - digitsStart)) << std::setfill('0') << number
+                << pattern.substr(digitsEnd);
+            filenames.push_back(oss.str());
+        }
+        return filenames;
+    }
+
+    void CBFSeries::run() {
+        // Readers are not thread-safe, so every worker has its own
+        std::unique_ptr<FileReader> reader;
+        std::vector<FileRequest> requests;
+        if (m_io != IOBackend::Mapped) {
+            reader = FileReader::create(m_io, m_direct, static_cast<unsigned>(m_batch));
+            requests.resize(m_batch);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            // A frame may be read once its slot has been handed to the caller
+            m_changed.wait(lock, [this]() {
+                return m_stop || m_claimed >= m_filenames.size() || m_claimed < m_next + m_slots.size();
+            });
+            if (m_stop || m_claimed >= m_filenames.size()) {
+                return;
+            }
+
+            size_t first = m_claimed;
+            size_t count = std::min(m_batch, std::min(m_filenames.size(), m_next + m_slots.size()) - first);
+            m_claimed += count;
+            lock.unlock();
+
+            // Read the files of the whole batch at once, then decode them one by one
+            if (reader) {
+                for (size_t i = 0; i < count; ++i) {
+                    requests[i].filename = m_filenames[first + i];
+                }
+                reader->read(requests.data(), count);
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                Slot& slot = m_slots[(first + i) % m_slots.size()];
+                bool ok;
+                std::string error;
+                if (!reader) {
+                    ok = slot.frame.read(m_filenames[first + i]);
+                } else if (requests[i].ok) {
+                    ok = slot.frame.decode(requests[i].buffer.data(), requests[i].buffer.size());
+                } else {
+                    ok = false;
+                    error = requests[i].error;
+                }
+                if (!ok && error.empty()) {
+                    error = slot.frame.getError();
+                }
+
+                lock.lock();
+                slot.ok = ok;
+                slot.error.swap(error);
+                slot.ready = true;
+                m_changed.notify_all();
+                lock.unlock();
+            }
+            lock.lock();
+        }
+    }
+
+    bool CBFSeries::next(CBFFrame& frame) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_next >= m_filenames.size()) {
+            m_error.clear();
+            return false;
+        }
+
+        Slot& slot = m_slots[m_next % m_slots.size()];
+        m_changed.wait(lock, [&slot]() { return slot.ready; });
+
+        // Swap so the caller's old buffers are reused for a later frame
+        std::swap(frame, slot.frame);
+        bool ok = slot.ok;
+        m_error = slot.error;
+        slot.ready = false;
+        ++m_next;
+        m_changed.notify_all();
+
+        return ok;
+    }
+
+    bool CBFSeries::forEach(const std::function<void(size_t, CBFFrame&)>& fn) {
+        CBFFrame frame;
+        for (size_t index = m_next; index < m_filenames.size(); ++index) {
+            if (!next(frame)) {
+                return false;
+            }
+            fn(index, frame);
+        }
+        return true;
+    }
+}
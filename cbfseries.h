@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CBFSERIES_H
+#define CBFSERIES_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "cbfframe.h"
+#include "filereader.h"
+
+namespace nanocbf {
+
+// Reads a sequence of frames on a pool of threads, keeping up to prefetch
+// frames in flight, and hands them back in order
+class CBFSeries {
+public:
+    // threads = 0 uses one thread per hardware core. With an io backend other
+    // than Mapped, every thread reads the files of prefetch / threads frames
+    // in one FileReader batch (opened with O_DIRECT if direct), then decodes
+    // them; use IoUring with a large prefetch to keep a fast device busy.
+    explicit CBFSeries(const std::vector<std::string>& filenames, unsigned threads = 0, size_t prefetch = 4,
+                       IOBackend io = IOBackend::Mapped, bool direct = false);
+    ~CBFSeries();
+
+    // Expand a template like "scan_?????.cbf" (XDS style, one '?' per digit)
+    // into zero-padded filenames for frame numbers first..last
+    static std::vector<std::string> expandTemplate(const std::string& pattern, int first, int last);
+
+    // Number of frames in the series
+    size_t size() const { return m_filenames.size(); }
+
+    // Move the next frame into frame; its previous buffers are recycled for
+    // later reads. Returns false at the end of the series (atEnd() is true,
+    // getError() empty), or if this frame could not be read (getError() holds
+    // the reason and the next call moves on to the following frame).
+    bool next(CBFFrame& frame);
+
+    // True once every frame has been handed out by next(). Call it from the
+    // thread that calls next().
+    bool atEnd() const { return m_next >= m_filenames.size(); }
+
+    // Call fn(index, frame) for every remaining frame in order; stops and
+    // returns false at the first frame that cannot be read
+    bool forEach(const std::function<void(size_t, CBFFrame&)>& fn);
+
+    // Error message of the frame last handed out by next(); empty if it was read
+    const std::string& getError() const { return m_error; }
+
+private:
+    CBFSeries(const CBFSeries&);
+    CBFSeries& operator=(const CBFSeries&);
+
+    struct Slot {
+        CBFFrame frame;
+        bool ready;
+        bool ok;
+        std::string error;
+        Slot() : ready(false), ok(false) {}
+    };
+
+    void run();
+
+    std::vector<std::string> m_filenames;
+    std::vector<Slot> m_slots;      // Frame i is read into slot i % m_slots.size()
+    size_t m_next;                  // Next frame handed to the caller
+    size_t m_claimed;               // Next frame to be read by a worker
+    IOBackend m_io;
+    bool m_direct;
+    size_t m_batch;                 // Frames claimed at a time by a worker
+    bool m_stop;
+    std::string m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<std::thread> m_workers;
+};
+
+} // namespace nanocbf
+
+#endif // CBFSERIES_H
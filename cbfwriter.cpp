@@ -0,0 +1,170 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "cbfwriter.h"
+#include <algorithm>
+
+namespace nanocbf {
+
+    CBFWriter::CBFWriter(unsigned threads, size_t maxQueued, FramePool* pool)
+        : m_pool(pool), m_maxQueued(std::max<size_t>(maxQueued, 1)), m_writing(0), m_stop(false), m_failed(false) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            m_encoders.push_back(std::thread(&CBFWriter::encodeLoop, this));
+        }
+        m_spare.reserve(m_maxQueued);
+        m_io = std::thread(&CBFWriter::writeLoop, this);
+    }
+
+    CBFWriter::~CBFWriter() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_changed.notify_all();
+        }
+        for (size_t i = 0; i < m_encoders.size(); ++i) {
+            m_encoders[i].join();
+        }
+        m_io.join();
+    }
+
+    void CBFWriter::submit(CBFFrame&& frame, const std::string& filename) {
+        // The template is patched for the next frame while this one waits
+        if (frame.headerTemplate) {
+            frame.header = frame.headerTemplate->text();
+            frame.headerTemplate = nullptr;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_jobs.size() + m_writing < m_maxQueued; });
+
+        // Reuse a written job, with the filename and file image buffers it grew
+        std::unique_ptr<Job> job;
+        if (m_spare.empty()) {
+            job.reset(new Job);
+        } else {
+            job = std::move(m_spare.back());
+            m_spare.pop_back();
+        }
+        job->frame = std::move(frame);
+        job->filename = filename;
+        job->claimed = job->encoded = job->ok = false;
+        job->preallocate = job->frame.preallocate;
+        job->sync = job->frame.sync;
+
+        m_jobs.push_back(std::move(job));
+        m_changed.notify_all();
+    }
+
+    bool CBFWriter::flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_jobs.empty() && m_writing == 0; });
+
+        bool ok = !m_failed;
+        m_failed = false;
+        return ok;
+    }
+
+    size_t CBFWriter::pending() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size() + m_writing;
+    }
+
+    void CBFWriter::fail(const std::string& error) {
+        // Called with m_mutex held
+        if (!m_failed) {
+            m_failed = true;
+            m_error = error;
+        }
+    }
+
+    void CBFWriter::encodeLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            // Oldest job nobody is encoding yet
+            Job* job = nullptr;
+            m_changed.wait(lock, [this, &job]() {
+                for (size_t i = 0; i < m_jobs.size() && !job; ++i) {
+                    if (!m_jobs[i]->claimed) job = m_jobs[i].get();
+                }
+                return job || m_stop;
+            });
+            if (!job) {
+                return;
+            }
+
+            job->claimed = true;
+            lock.unlock();
+
+            bool ok = job->frame.encode(job->filename, job->bytes);
+
+            // The pixels are no longer needed once compressed
+            if (m_pool) {
+                m_pool->release(std::move(job->frame));
+                job->frame.clear();
+            } else {
+                std::vector<int32_t>().swap(job->frame.data);
+            }
+
+            lock.lock();
+            job->ok = ok;
+            job->encoded = true;
+            m_changed.notify_all();
+        }
+    }
+
+    void CBFWriter::writeLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_changed.wait(lock, [this]() { return (!m_jobs.empty() && m_jobs.front()->encoded) || (m_stop && m_jobs.empty()); });
+            if (m_jobs.empty()) {
+                return;
+            }
+
+            std::unique_ptr<Job> job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            ++m_writing;
+            lock.unlock();
+
+            bool ok = job->ok;
+            if (ok) {
+                FilePart part = {job->bytes.data(), job->bytes.size()};
+                ok = writeFile(job->filename, &part, 1, job->preallocate, job->sync);
+            }
+
+            lock.lock();
+            if (!ok) {
+                fail(job->ok ? "Could not write file: " + job->filename : "Frame has no data: " + job->filename);
+            }
+            if (m_spare.size() < m_maxQueued) {
+                m_spare.push_back(std::move(job));
+            }
+            --m_writing;
+            m_changed.notify_all();
+        }
+    }
+}
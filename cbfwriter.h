@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CBFWRITER_H
+#define CBFWRITER_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "cbfframe.h"
+#include "framepool.h"
+
+namespace nanocbf {
+
+// Writes frames in the background: worker threads compress and hash them,
+// and a single I/O thread writes the files in submission order
+class CBFWriter {
+public:
+    // threads = 0 uses one encoding thread per hardware core; at most
+    // maxQueued frames are held before submit() blocks. If pool is given,
+    // frames are released to it once compressed, for the producer to reuse.
+    explicit CBFWriter(unsigned threads = 0, size_t maxQueued = 8, FramePool* pool = nullptr);
+    ~CBFWriter();   // Writes everything still queued
+
+    // Queue frame to be written to filename, taking ownership of its data.
+    // Blocks while maxQueued frames are waiting to be written. A headerTemplate
+    // is copied into header, so it can be patched for the next frame.
+    void submit(CBFFrame&& frame, const std::string& filename);
+
+    // Wait until every submitted frame is on disk. Returns false if any frame
+    // failed since the previous flush (see getError).
+    bool flush();
+
+    // Frames submitted but not yet written
+    size_t pending() const;
+
+    // Get error message of the first failed frame since the previous flush
+    const std::string& getError() const { return m_error; }
+
+private:
+    CBFWriter(const CBFWriter&);
+    CBFWriter& operator=(const CBFWriter&);
+
+    struct Job {
+        CBFFrame frame;
+        std::string filename;
+        std::vector<uint8_t> bytes;     // Encoded file image
+        bool claimed;
+        bool encoded;
+        bool ok;
+        bool preallocate;               // Copied from the frame when submitted
+        SyncPolicy sync;
+        Job() : claimed(false), encoded(false), ok(false), preallocate(false), sync(SyncPolicy::None) {}
+    };
+
+    void encodeLoop();
+    void writeLoop();
+    void fail(const std::string& error);
+
+    std::deque<std::unique_ptr<Job> > m_jobs;   // In submission order; the front is written next
+    std::vector<std::unique_ptr<Job> > m_spare; // Written jobs kept for their buffers
+    FramePool* m_pool;
+    size_t m_maxQueued;
+    size_t m_writing;                           // Jobs popped but not yet on disk
+    bool m_stop;
+    bool m_failed;
+    std::string m_error;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<std::thread> m_encoders;
+    std::thread m_io;
+};
+
+} // namespace nanocbf
+
+#endif // CBFWRITER_H
@@ -0,0 +1,354 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "compression.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NANOCBF_LITTLE_ENDIAN 1
+#elif defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+#define NANOCBF_LITTLE_ENDIAN 1
+#endif
+
+namespace nanocbf {
+
+    const char* conversionsName(Compression compression) {
+        switch (compression) {
+            case Compression::Packed: return "x-CBF_PACKED";
+            case Compression::PackedV2: return "x-CBF_PACKED_V2";
+            case Compression::None: return "x-CBF_NONE";
+            default: return "x-CBF_BYTE_OFFSET";
+        }
+    }
+
+    bool parseConversions(const std::string& conversions, Compression& compression) {
+        if (conversions.empty() || conversions == "x-CBF_BYTE_OFFSET") {
+            compression = Compression::ByteOffset;
+        } else if (conversions == "x-CBF_PACKED") {
+            compression = Compression::Packed;
+        } else if (conversions == "x-CBF_PACKED_V2") {
+            compression = Compression::PackedV2;
+        } else if (conversions == "x-CBF_NONE") {
+            compression = Compression::None;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Field width of each block header bit code; 0xFF marks an unused code
+    static const uint8_t PACKED_BITS[8] = {0, 4, 5, 6, 7, 8, 16, 32};
+    static const uint8_t PACKED_V2_BITS[16] = {0, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 32, 0xFF};
+
+    // Largest block of differences sharing a header
+    static const size_t PACKED_MAX_BLOCK = 128;
+
+    // Differences computed at a time by the encoder; blocks do not cross them
+    static const size_t PACKED_CHUNK_PIXELS = 4096;
+
+    // Prediction of pixel i from the pixels before it
+    template <typename T>
+    static inline int64_t predictPixel(const T* pixels, size_t i, size_t width) {
+        if (i == 0) {
+            return 0;
+        }
+        if (i <= width || width < 2) {
+            return pixels[i - 1];
+        }
+        int64_t sum = static_cast<int64_t>(pixels[i - 1]) + pixels[i - width + 1] + pixels[i - width] + pixels[i - width - 1];
+        return (sum + 2) / 4;
+    }
+
+    // Least significant bit first reader of the packed stream
+    class BitReader {
+    public:
+        BitReader(const uint8_t* in, size_t size) : m_in(in), m_size(size), m_pos(0), m_bits(0), m_count(0) {}
+
+        // Make at least n <= 32 bits available; false if the stream ends first
+        bool need(unsigned n) {
+            return m_count >= n || refill(n);
+        }
+
+        uint32_t take(unsigned n) {
+            uint32_t value = static_cast<uint32_t>(m_bits & ((static_cast<uint64_t>(1) << n) - 1));
+            m_bits >>= n;
+            m_count -= n;
+            return value;
+        }
+
+    private:
+        const uint8_t* m_in;
+        size_t m_size;
+        size_t m_pos;
+        uint64_t m_bits;
+        unsigned m_count;
+
+        bool refill(unsigned n) {
+            // Four bytes at a time away from the end of the stream
+            if (m_pos + 4 <= m_size) {
+                const uint8_t* p = m_in + m_pos;
+                uint32_t word = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                                (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+                m_bits |= static_cast<uint64_t>(word) << m_count;
+                m_count += 32;
+                m_pos += 4;
+                return true;
+            }
+            while (m_count < n) {
+                if (m_pos == m_size) return false;
+                m_bits |= static_cast<uint64_t>(m_in[m_pos++]) << m_count;
+                m_count += 8;
+            }
+            return true;
+        }
+    };
+
+    // Least significant bit first writer of the packed stream
+    class BitWriter {
+    public:
+        explicit BitWriter(uint8_t* out) : m_out(out), m_pos(0), m_bits(0), m_count(0) {}
+
+        // Append the low n <= 32 bits of value
+        void put(uint32_t value, unsigned n) {
+            m_bits |= (static_cast<uint64_t>(value) & ((static_cast<uint64_t>(1) << n) - 1)) << m_count;
+            m_count += n;
+            if (m_count >= 32) {
+                for (int b = 0; b < 4; ++b) {
+                    m_out[m_pos++] = static_cast<uint8_t>(m_bits >> (8 * b));
+                }
+                m_bits >>= 32;
+                m_count -= 32;
+            }
+        }
+
+        // Pad the last byte with zeros; returns the number of bytes written
+        size_t finish() {
+            while (m_count > 0) {
+                m_out[m_pos++] = static_cast<uint8_t>(m_bits);
+                m_bits >>= 8;
+                m_count = m_count > 8 ? m_count - 8 : 0;
+            }
+            return m_pos;
+        }
+
+    private:
+        uint8_t* m_out;
+        size_t m_pos;
+        uint64_t m_bits;
+        unsigned m_count;
+    };
+
+    // Two's complement value of the low bits bits of field
+    static inline int32_t signExtend(uint32_t field, unsigned bits) {
+        if (bits == 0) return 0;
+        if (bits == 32) return static_cast<int32_t>(field);
+        uint32_t sign = 1u << (bits - 1);
+        return static_cast<int32_t>(field ^ sign) - static_cast<int32_t>(sign);
+    }
+
+    template <typename T>
+    size_t decodePacked(const uint8_t* compressed, size_t size, T* out, size_t count, size_t width, bool v2) {
+        const uint8_t* fieldBits = v2 ? PACKED_V2_BITS : PACKED_BITS;
+        unsigned headerBits = v2 ? 7 : 6;
+        BitReader in(compressed, size);
+        // The first row and a pixel are predicted from the previous pixel,
+        // the rest from the mean of four neighbours
+        size_t firstAveraged = width >= 2 ? width + 1 : count;
+        size_t i = 0;
+        while (i < count && in.need(headerBits)) {
+            uint32_t header = in.take(headerBits);
+            size_t blockEnd = std::min(count, i + (static_cast<size_t>(1) << (header & 7)));
+            unsigned bits = fieldBits[header >> 3];
+            if (bits > 32) {
+                break;
+            }
+
+            // Two's complement fields are sign-extended as (field ^ sign) - sign
+            uint32_t sign = bits > 0 ? 1u << (bits - 1) : 0;
+            for (; i < blockEnd && i < firstAveraged; ++i) {
+                if (!in.need(bits)) {
+                    return i;
+                }
+                uint32_t diff = (in.take(bits) ^ sign) - sign;
+                out[i] = static_cast<T>(static_cast<uint32_t>(predictPixel(out, i, width)) + diff);
+            }
+            if (i == blockEnd) {
+                continue;
+            }
+
+            T left = out[i - 1];
+            const T* above = out + i - width;
+            for (; i < blockEnd; ++i, ++above) {
+                if (!in.need(bits)) {
+                    return i;
+                }
+                uint32_t diff = (in.take(bits) ^ sign) - sign;
+                int64_t prediction = (static_cast<int64_t>(left) + above[1] + above[0] + above[-1] + 2) / 4;
+                left = static_cast<T>(static_cast<uint32_t>(prediction) + diff);
+                out[i] = left;
+            }
+        }
+        return i;
+    }
+
+    // Bits needed to store value in two's complement (0 for 0); branch-free,
+    // since zero and non-zero differences are mixed at random in noisy frames
+    static inline unsigned significantBits(int32_t value) {
+        uint32_t magnitude = static_cast<uint32_t>(value < 0 ? ~value : value);
+        uint32_t marked = (magnitude << 1) | 1;
+#if defined(__GNUC__) || defined(__clang__)
+        unsigned bits = 32 - static_cast<unsigned>(__builtin_clz(marked));
+#else
+        unsigned bits = 0;
+        while (marked != 0) {
+            marked >>= 1;
+            ++bits;
+        }
+#endif
+        return bits - (value == 0 ? 1 : 0);
+    }
+
+    template <typename T>
+    size_t encodePacked(const T* data, size_t count, size_t width, bool v2, uint8_t* out) {
+        const uint8_t* fieldBits = v2 ? PACKED_V2_BITS : PACKED_BITS;
+        unsigned headerBits = v2 ? 7 : 6;
+        BitWriter writer(out);
+
+        // Field width that holds a given number of bits, and its header code
+        uint8_t fieldWidth[33], fieldCode[33];
+        for (unsigned bits = 0, code = 0; bits <= 32; ++bits) {
+            while (fieldBits[code] < bits) ++code;
+            fieldWidth[bits] = fieldBits[code];
+            fieldCode[fieldBits[code]] = static_cast<uint8_t>(code);
+        }
+
+        size_t firstAveraged = width >= 2 ? width + 1 : count;
+        int32_t diffs[PACKED_CHUNK_PIXELS];
+        uint8_t widths[PACKED_CHUNK_PIXELS];
+        for (size_t chunkStart = 0; chunkStart < count; chunkStart += PACKED_CHUNK_PIXELS) {
+            size_t length = std::min(count - chunkStart, PACKED_CHUNK_PIXELS);
+            size_t k = 0;
+            for (; k < length && chunkStart + k < firstAveraged; ++k) {
+                size_t i = chunkStart + k;
+                diffs[k] = static_cast<int32_t>(static_cast<uint32_t>(data[i]) - static_cast<uint32_t>(predictPixel(data, i, width)));
+            }
+            for (; k < length; ++k) {
+                const T* pixel = data + chunkStart + k;
+                const T* above = pixel - width;
+                int64_t prediction = (static_cast<int64_t>(pixel[-1]) + above[1] + above[0] + above[-1] + 2) / 4;
+                diffs[k] = static_cast<int32_t>(static_cast<uint32_t>(*pixel) - static_cast<uint32_t>(prediction));
+            }
+            for (k = 0; k < length; ++k) {
+                widths[k] = fieldWidth[significantBits(diffs[k])];
+            }
+
+            // Keep doubling a block while one header for both halves saves
+            // more than the wider field costs
+            for (size_t start = 0; start < length; ) {
+                size_t block = 1;
+                unsigned log2Block = 0;
+                unsigned bits = widths[start];
+                while (2 * block <= PACKED_MAX_BLOCK && start + 2 * block <= length) {
+                    unsigned nextBits = *std::max_element(widths + start + block, widths + start + 2 * block);
+                    unsigned merged = std::max(bits, nextBits);
+                    if (2 * block * merged > block * (bits + nextBits) + headerBits) {
+                        break;
+                    }
+                    block *= 2;
+                    ++log2Block;
+                    bits = merged;
+                }
+
+                writer.put(log2Block | (static_cast<unsigned>(fieldCode[bits]) << 3), headerBits);
+                for (size_t k = start; k < start + block; ++k) {
+                    writer.put(static_cast<uint32_t>(diffs[k]), bits);
+                }
+                start += block;
+            }
+        }
+        return writer.finish();
+    }
+
+    template <typename T>
+    size_t decodeUncompressed(const uint8_t* data, size_t size, T* out, size_t count, size_t elementSize, bool isSigned) {
+        if (elementSize != 1 && elementSize != 2 && elementSize != 4) {
+            return 0;
+        }
+        count = std::min(count, size / elementSize);
+#if defined(NANOCBF_LITTLE_ENDIAN)
+        if (elementSize == sizeof(T)) {
+            std::memcpy(out, data, count * sizeof(T));
+            return count;
+        }
+#endif
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* element = data + i * elementSize;
+            uint32_t value = 0;
+            for (size_t b = 0; b < elementSize; ++b) {
+                value |= static_cast<uint32_t>(element[b]) << (8 * b);
+            }
+            if (isSigned && elementSize < 4) {
+                value = static_cast<uint32_t>(signExtend(value, static_cast<unsigned>(8 * elementSize)));
+            }
+            out[i] = static_cast<T>(value);
+        }
+        return count;
+    }
+
+    template <typename T>
+    size_t encodeUncompressed(const T* data, size_t count, uint8_t* out) {
+#if defined(NANOCBF_LITTLE_ENDIAN)
+        std::memcpy(out, data, count * sizeof(T));
+#else
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t value = static_cast<uint32_t>(data[i]);
+            for (size_t b = 0; b < sizeof(T); ++b) {
+                out[i * sizeof(T) + b] = static_cast<uint8_t>(value >> (8 * b));
+            }
+        }
+#endif
+        return count * sizeof(T);
+    }
+
+    template size_t decodePacked<int32_t>(const uint8_t*, size_t, int32_t*, size_t, size_t, bool);
+    template size_t decodePacked<uint32_t>(const uint8_t*, size_t, uint32_t*, size_t, size_t, bool);
+    template size_t decodePacked<int16_t>(const uint8_t*, size_t, int16_t*, size_t, size_t, bool);
+    template size_t decodePacked<uint16_t>(const uint8_t*, size_t, uint16_t*, size_t, size_t, bool);
+
+    template size_t encodePacked<int32_t>(const int32_t*, size_t, size_t, bool, uint8_t*);
+    template size_t encodePacked<uint32_t>(const uint32_t*, size_t, size_t, bool, uint8_t*);
+    template size_t encodePacked<int16_t>(const int16_t*, size_t, size_t, bool, uint8_t*);
+    template size_t encodePacked<uint16_t>(const uint16_t*, size_t, size_t, bool, uint8_t*);
+
+    template size_t decodeUncompressed<int32_t>(const uint8_t*, size_t, int32_t*, size_t, size_t, bool);
+    template size_t decodeUncompressed<uint32_t>(const uint8_t*, size_t, uint32_t*, size_t, size_t, bool);
+    template size_t decodeUncompressed<int16_t>(const uint8_t*, size_t, int16_t*, size_t, size_t, bool);
+    template size_t decodeUncompressed<uint16_t>(const uint8_t*, size_t, uint16_t*, size_t, size_t, bool);
+
+    template size_t encodeUncompressed<int32_t>(const int32_t*, size_t, uint8_t*);
+    template size_t encodeUncompressed<uint32_t>(const uint32_t*, size_t, uint8_t*);
+    template size_t encodeUncompressed<int16_t>(const int16_t*, size_t, uint8_t*);
+    template size_t encodeUncompressed<uint16_t>(const uint16_t*, size_t, uint8_t*);
+}
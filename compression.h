@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace nanocbf {
+
+// Compression of the binary data, named by the conversions parameter of its
+// Content-Type
+enum class Compression {
+    ByteOffset, // x-CBF_BYTE_OFFSET (default)
+    Packed,     // x-CBF_PACKED: CCP4 style bit packing of differences
+    PackedV2,   // x-CBF_PACKED_V2: as Packed, with more field widths to choose from
+    None        // x-CBF_NONE: little-endian elements as they are
+};
+
+// Conversions value written for compression
+const char* conversionsName(Compression compression);
+
+// Compression named by a conversions value; an empty value is taken as
+// x-CBF_BYTE_OFFSET. Returns false for compressions that are not supported.
+bool parseConversions(const std::string& conversions, Compression& compression);
+
+// The function templates below are instantiated for the pixel types int32_t,
+// uint32_t, int16_t and uint16_t.
+
+// Packed data is a sequence of blocks of 2^n differences that share one bit
+// width, each block starting with a 6-bit (7-bit for v2) header. A difference
+// is from the previous pixel in the first row and from the rounded mean of the
+// left and three upper neighbours after that, as CCP4 pack_c does. The codec
+// has only been round-tripped against itself, not against CBFlib files, so
+// CBFFrame reads and writes packed data only when built with NANOCBF_PACKED.
+
+// Decode up to count pixels of a frame with width columns into out. Returns
+// the number of pixels decoded (less than count if the stream ends).
+template <typename T>
+size_t decodePacked(const uint8_t* compressed, size_t size, T* out, size_t count, size_t width, bool v2);
+
+// Worst-case packed size: a header and a 32-bit field for every pixel
+inline size_t packedMaxSize(size_t count) { return 5 * count + 1; }
+
+// Compress count pixels of a frame with width columns into out, which must
+// hold packedMaxSize() bytes. Returns the number of bytes written.
+template <typename T>
+size_t encodePacked(const T* data, size_t count, size_t width, bool v2, uint8_t* out);
+
+// Copy up to count little-endian elements of elementSize (1, 2 or 4) bytes
+// into out, sign-extending them if isSigned. Elements as wide as T are copied
+// straight into out. Returns the number of pixels copied.
+template <typename T>
+size_t decodeUncompressed(const uint8_t* data, size_t size, T* out, size_t count, size_t elementSize, bool isSigned);
+
+// Store count pixels as little-endian elements of sizeof(T) bytes into out.
+// Returns the number of bytes written.
+template <typename T>
+size_t encodeUncompressed(const T* data, size_t count, uint8_t* out);
+
+} // namespace nanocbf
+
+#endif // COMPRESSION_H
@@ -0,0 +1,448 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "filereader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NANOCBF_HAVE_PREAD 1
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(NANOCBF_HAVE_IO_URING) && defined(NANOCBF_HAVE_PREAD)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#else
+#undef NANOCBF_HAVE_IO_URING
+#endif
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace nanocbf {
+
+    AlignedBuffer::~AlignedBuffer() {
+#if defined(_MSC_VER)
+        _aligned_free(m_data);
+#else
+        std::free(m_data);
+#endif
+    }
+
+    AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity) {
+        other.m_data = nullptr;
+        other.m_size = other.m_capacity = 0;
+    }
+
+    AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+        return *this;
+    }
+
+    bool AlignedBuffer::resize(size_t size) {
+        if (size > m_capacity) {
+            // Whole blocks, so O_DIRECT reads can fill the buffer up to its capacity
+            size_t capacity = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#if defined(_MSC_VER)
+            _aligned_free(m_data);
+            void* memory = _aligned_malloc(capacity, ALIGNMENT);
+#else
+            std::free(m_data);
+            void* memory = nullptr;
+            if (posix_memalign(&memory, ALIGNMENT, capacity) != 0) {
+                memory = nullptr;
+            }
+#endif
+            m_data = static_cast<uint8_t*>(memory);
+            m_size = m_capacity = 0;
+            if (!m_data) {
+                return false;
+            }
+            m_capacity = capacity;
+        }
+        m_size = size;
+        return true;
+    }
+
+#ifdef NANOCBF_HAVE_PREAD
+    // Largest read issued at once; longer files are read in pieces
+    static const size_t MAX_READ_SIZE = static_cast<size_t>(1) << 30;
+
+    // Open filename for reading with O_DIRECT if direct, clearing direct if the
+    // filesystem does not allow it. Returns -1 if the file cannot be opened.
+    static int openFile(const std::string& filename, bool& direct) {
+#ifdef O_DIRECT
+        if (direct) {
+            int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+            if (fd >= 0 || errno != EINVAL) {
+                return fd;
+            }
+        }
+#endif
+        direct = false;
+        return ::open(filename.c_str(), O_RDONLY);
+    }
+
+    // Size request.buffer for the file open at fd; O_DIRECT reads whole blocks,
+    // which the buffer's capacity always holds
+    static bool prepareRequest(FileRequest& request, int fd, size_t& fileSize) {
+        struct stat st;
+        if (fd < 0) {
+            request.error = "Could not open file: " + request.filename;
+            return false;
+        }
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            request.error = "Could not read file: " + request.filename;
+            return false;
+        }
+        fileSize = static_cast<size_t>(st.st_size);
+        if (!request.buffer.resize(fileSize)) {
+            request.error = "Out of memory reading file: " + request.filename;
+            return false;
+        }
+        return true;
+    }
+
+    // Read the file open at fd from offset got to its end with pread. A direct
+    // read the kernel refuses is retried on a descriptor without O_DIRECT.
+    static bool readRemainder(FileRequest& request, int& fd, bool& direct, size_t fileSize, size_t got) {
+        while (got < fileSize) {
+            // Direct reads must cover whole blocks, so they may run past the end of the file
+            size_t length = std::min(MAX_READ_SIZE, (direct ? request.buffer.capacity() : fileSize) - got);
+            ssize_t n = pread(fd, request.buffer.data() + got, length, static_cast<off_t>(got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && direct && errno == EINVAL) {
+                ::close(fd);
+                direct = false;
+                fd = ::open(request.filename.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    break;
+                }
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += static_cast<size_t>(n);
+        }
+
+        if (got < fileSize) {
+            request.error = "Could not read file: " + request.filename;
+            return false;
+        }
+        request.buffer.resize(fileSize);
+        return true;
+    }
+#endif
+
+    // Reads one file after the other
+    class BlockingFileReader : public FileReader {
+    public:
+        explicit BlockingFileReader(bool direct) : m_direct(direct) {}
+
+        bool read(FileRequest* requests, size_t count) {
+            bool allOk = true;
+            for (size_t i = 0; i < count; ++i) {
+                FileRequest& request = requests[i];
+                request.error.clear();
+                request.ok = readOne(request);
+                allOk = allOk && request.ok;
+            }
+            return allOk;
+        }
+
+        const char* name() const { return m_direct ? "pread (O_DIRECT)" : "pread"; }
+
+    private:
+        bool m_direct;
+
+        bool readOne(FileRequest& request) {
+#ifdef NANOCBF_HAVE_PREAD
+            bool direct = m_direct;
+            int fd = openFile(request.filename, direct);
+            size_t fileSize;
+            bool ok = prepareRequest(request, fd, fileSize) && readRemainder(request, fd, direct, fileSize, 0);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return ok;
+#else
+            std::ifstream file(request.filename, std::ios::binary);
+            if (!file.is_open()) {
+                request.error = "Could not open file: " + request.filename;
+                return false;
+            }
+            file.seekg(0, std::ios::end);
+            size_t fileSize = static_cast<size_t>(file.tellg());
+            file.seekg(0, std::ios::beg);
+            if (!request.buffer.resize(fileSize)) {
+                request.error = "Out of memory reading file: " + request.filename;
+                return false;
+            }
+            file.read(reinterpret_cast<char*>(request.buffer.data()), static_cast<std::streamsize>(fileSize));
+            if (static_cast<size_t>(file.gcount()) != fileSize) {
+                request.error = "Could not read file: " + request.filename;
+                return false;
+            }
+            return true;
+#endif
+        }
+    };
+
+#ifdef NANOCBF_HAVE_IO_URING
+    // Submits the reads of up to queueDepth files at once and waits for all of
+    // them, so the device sees a deep queue even from a single thread. Opening
+    // and short reads are handled synchronously.
+    class IoUringFileReader : public FileReader {
+    public:
+        explicit IoUringFileReader(bool direct)
+            : m_direct(direct), m_ring(-1), m_sqRing(nullptr), m_cqRing(nullptr), m_sqes(nullptr),
+              m_sqRingSize(0), m_cqRingSize(0), m_sqesSize(0), m_entries(0) {}
+
+        ~IoUringFileReader() {
+            if (m_sqes) munmap(m_sqes, m_sqesSize);
+            if (m_cqRing && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingSize);
+            if (m_sqRing) munmap(m_sqRing, m_sqRingSize);
+            if (m_ring >= 0) ::close(m_ring);
+        }
+
+        // Set up the rings; false if io_uring is not available
+        bool init(unsigned queueDepth) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            m_ring = static_cast<int>(syscall(__NR_io_uring_setup, std::max(queueDepth, 1u), &params));
+            if (m_ring < 0) {
+                return false;
+            }
+
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMap) {
+                m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+            }
+            m_sqRing = mapRing(m_sqRingSize, IORING_OFF_SQ_RING);
+            m_cqRing = singleMap ? m_sqRing : mapRing(m_cqRingSize, IORING_OFF_CQ_RING);
+            m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            m_sqes = static_cast<io_uring_sqe*>(mapRing(m_sqesSize, IORING_OFF_SQES));
+            if (!m_sqRing || !m_cqRing || !m_sqes) {
+                return false;
+            }
+
+            uint8_t* sq = static_cast<uint8_t*>(m_sqRing);
+            uint8_t* cq = static_cast<uint8_t*>(m_cqRing);
+            m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            m_entries = params.sq_entries;
+            return true;
+        }
+
+        bool read(FileRequest* requests, size_t count) {
+            bool allOk = true;
+            for (size_t start = 0; start < count; start += m_entries) {
+                size_t batch = std::min(count - start, static_cast<size_t>(m_entries));
+                allOk = readBatch(requests + start, batch) && allOk;
+            }
+            return allOk;
+        }
+
+        const char* name() const { return m_direct ? "io_uring (O_DIRECT)" : "io_uring"; }
+
+    private:
+        // A file of the batch being read
+        struct Pending {
+            int fd;
+            bool direct;
+            size_t fileSize;
+            bool queued;    // A read is in the ring and its completion has not been reaped
+        };
+
+        bool m_direct;
+        int m_ring;
+        void* m_sqRing;
+        void* m_cqRing;
+        io_uring_sqe* m_sqes;
+        size_t m_sqRingSize, m_cqRingSize, m_sqesSize;
+        unsigned m_entries;
+        unsigned* m_sqHead;
+        unsigned* m_sqTail;
+        unsigned m_sqMask;
+        unsigned* m_sqArray;
+        unsigned* m_cqHead;
+        unsigned* m_cqTail;
+        unsigned m_cqMask;
+        io_uring_cqe* m_cqes;
+        std::vector<Pending> m_pending;
+
+        void* mapRing(size_t size, off_t offset) {
+            void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, offset);
+            return ring == MAP_FAILED ? nullptr : ring;
+        }
+
+        int enter(unsigned toSubmit, unsigned minComplete) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, m_ring, toSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+        }
+
+        bool readBatch(FileRequest* requests, size_t count) {
+            // Open every file and queue one read for each
+            m_pending.resize(count);
+            unsigned tail = *m_sqTail;
+            unsigned queued = 0;
+            for (size_t i = 0; i < count; ++i) {
+                FileRequest& request = requests[i];
+                Pending& pending = m_pending[i];
+                request.error.clear();
+                request.ok = false;
+                pending.direct = m_direct;
+                pending.queued = false;
+                pending.fd = openFile(request.filename, pending.direct);
+                if (!prepareRequest(request, pending.fd, pending.fileSize)) {
+                    continue;
+                }
+                if (pending.fileSize == 0) {
+                    request.ok = true;
+                    continue;
+                }
+
+                unsigned index = tail & m_sqMask;
+                io_uring_sqe& sqe = m_sqes[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = pending.fd;
+                sqe.addr = reinterpret_cast<uint64_t>(request.buffer.data());
+                sqe.len = static_cast<uint32_t>(std::min(MAX_READ_SIZE, pending.direct ? request.buffer.capacity() : pending.fileSize));
+                sqe.off = 0;
+                sqe.user_data = i;
+                m_sqArray[index] = index;
+                pending.queued = true;
+                ++tail;
+                ++queued;
+            }
+            __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+            // Submit them all, then collect completions until every read is back.
+            // If submitting fails, the reads already submitted still write into
+            // the request buffers, so they are waited for before anything is freed
+            unsigned toSubmit = queued;
+            unsigned completed = 0;
+            bool submitting = true;
+            bool waitFailed = false;
+            while (completed < queued - (submitting ? 0 : toSubmit)) {
+                int submitted = enter(submitting ? toSubmit : 0, 1);
+                if (submitted < 0) {
+                    unsigned inFlight = queued - toSubmit - completed;
+                    bool transient = errno == EINTR || ((errno == EAGAIN || errno == EBUSY) && inFlight > 0);
+                    if (!transient && submitting) {
+                        submitting = false;
+                        continue;
+                    }
+                    if (!transient) {
+                        waitFailed = true;
+                        break;
+                    }
+                } else {
+                    toSubmit -= std::min(toSubmit, static_cast<unsigned>(submitted));
+                }
+
+                unsigned head = *m_cqHead;
+                unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+                for (; head != cqTail; ++head, ++completed) {
+                    const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+                    size_t i = static_cast<size_t>(cqe.user_data);
+                    Pending& pending = m_pending[i];
+                    pending.queued = false;
+                    // Failed and short reads, e.g. direct reads the filesystem refuses, are finished by pread
+                    size_t got = cqe.res > 0 ? std::min(static_cast<size_t>(cqe.res), pending.fileSize) : 0;
+                    requests[i].ok = readRemainder(requests[i], pending.fd, pending.direct, pending.fileSize, got);
+                }
+                __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            }
+
+            if (!submitting && !waitFailed) {
+                // Take back the reads the kernel never consumed, so the next batch
+                // does not submit them, and finish them with pread instead
+                unsigned sqHead = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+                for (unsigned k = sqHead; k != tail; ++k) {
+                    size_t i = static_cast<size_t>(m_sqes[m_sqArray[k & m_sqMask]].user_data);
+                    Pending& pending = m_pending[i];
+                    pending.queued = false;
+                    requests[i].ok = readRemainder(requests[i], pending.fd, pending.direct, pending.fileSize, 0);
+                }
+                __atomic_store_n(m_sqTail, sqHead, __ATOMIC_RELEASE);
+            }
+
+            bool allOk = true;
+            for (size_t i = 0; i < count; ++i) {
+                if (m_pending[i].queued) {
+                    // Only if waiting failed: the ring is unusable and the read may still land
+                    requests[i].ok = false;
+                    requests[i].error = "io_uring read still in flight: " + requests[i].filename;
+                }
+                if (m_pending[i].fd >= 0) {
+                    ::close(m_pending[i].fd);
+                }
+                if (!requests[i].ok && requests[i].error.empty()) {
+                    requests[i].error = "Could not read file: " + requests[i].filename;
+                }
+                allOk = allOk && requests[i].ok;
+            }
+            return allOk;
+        }
+    };
+#endif
+
+    std::unique_ptr<FileReader> FileReader::create(IOBackend backend, bool direct, unsigned queueDepth) {
+#ifdef NANOCBF_HAVE_IO_URING
+        if (backend == IOBackend::IoUring) {
+            std::unique_ptr<IoUringFileReader> reader(new IoUringFileReader(direct));
+            if (reader->init(queueDepth)) {
+                return std::unique_ptr<FileReader>(reader.release());
+            }
+        }
+#else
+        (void)queueDepth;
+#endif
+        (void)backend;
+        return std::unique_ptr<FileReader>(new BlockingFileReader(direct));
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace nanocbf {
+
+// Heap buffer aligned to ALIGNMENT bytes, as O_DIRECT reads require. Like a
+// std::vector it keeps its capacity when shrunk, but growing does not
+// preserve the contents.
+class AlignedBuffer {
+public:
+    static const size_t ALIGNMENT = 4096;
+
+    AlignedBuffer() : m_data(nullptr), m_size(0), m_capacity(0) {}
+    ~AlignedBuffer();
+    AlignedBuffer(AlignedBuffer&& other);
+    AlignedBuffer& operator=(AlignedBuffer&& other);
+
+    // Returns false if the memory could not be allocated
+    bool resize(size_t size);
+
+    uint8_t* data() { return m_data; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    AlignedBuffer(const AlignedBuffer&);
+    AlignedBuffer& operator=(const AlignedBuffer&);
+
+    uint8_t* m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
+
+// A whole file to be read by a FileReader
+struct FileRequest {
+    std::string filename;
+    AlignedBuffer buffer;   // Contents of the file once read; capacity is reused by later reads
+    bool ok;                // Whether the file was read
+    std::string error;      // Why not, if it was not
+
+    FileRequest() : ok(false) {}
+};
+
+// How CBFSeries and FileReader::create get at file contents
+enum class IOBackend {
+    Mapped,     // Every frame maps its own file (CBFFrame::read); not a FileReader
+    Blocking,   // pread into buffers, one file after the other
+    IoUring     // Linux io_uring: the reads of a whole batch are in flight at once
+};
+
+// Reads whole files into memory, a batch at a time. Implementations need not
+// be thread-safe; use one reader per thread. Derive from it to plug in
+// another source of files.
+class FileReader {
+public:
+    virtual ~FileReader() {}
+
+    // Read every request's file into its buffer, setting ok and error.
+    // Returns false if any of them could not be read.
+    virtual bool read(FileRequest* requests, size_t count) = 0;
+
+    // Name of the implementation: "pread", "io_uring", ...
+    virtual const char* name() const = 0;
+
+    // Reader for backend (Mapped gives a Blocking one). IoUring falls back to
+    // Blocking where the kernel or build does not support it; queueDepth is
+    // the most reads it keeps in flight. With direct, files are opened with
+    // O_DIRECT to bypass the page cache where the filesystem allows it.
+    static std::unique_ptr<FileReader> create(IOBackend backend, bool direct = false, unsigned queueDepth = 32);
+};
+
+} // namespace nanocbf
+
+#endif // FILEREADER_H
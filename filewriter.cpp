@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "filewriter.h"
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NANOCBF_HAVE_WRITEV 1
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace nanocbf {
+
+#ifdef NANOCBF_HAVE_WRITEV
+    // Write all of iov, advancing through it after partial writes
+    static bool writeAll(int fd, std::vector<iovec>& iov) {
+        size_t first = 0;
+        while (first < iov.size()) {
+            int count = static_cast<int>(std::min<size_t>(iov.size() - first, IOV_MAX));
+            ssize_t written = writev(fd, iov.data() + first, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            size_t remaining = static_cast<size_t>(written);
+            while (first < iov.size() && remaining >= iov[first].iov_len) {
+                remaining -= iov[first].iov_len;
+                ++first;
+            }
+            if (remaining > 0) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+                iov[first].iov_len -= remaining;
+            }
+        }
+        return true;
+    }
+#endif
+
+    bool writeFile(const std::string& filename, const FilePart* parts, size_t count, bool preallocate, SyncPolicy sync) {
+#ifdef NANOCBF_HAVE_WRITEV
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            return false;
+        }
+
+        std::vector<iovec> iov;
+        iov.reserve(count);
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (parts[i].size == 0) continue;
+            iovec entry;
+            entry.iov_base = const_cast<void*>(parts[i].data);
+            entry.iov_len = parts[i].size;
+            iov.push_back(entry);
+            total += parts[i].size;
+        }
+
+#ifdef __linux__
+        // Best effort: filesystems without fallocate just allocate as they are written
+        if (preallocate && total > 0) {
+            fallocate(fd, 0, 0, static_cast<off_t>(total));
+        }
+#else
+        (void)preallocate;
+#endif
+
+        bool ok = writeAll(fd, iov);
+        if (ok && sync == SyncPolicy::Full) {
+            ok = fsync(fd) == 0;
+        } else if (ok && sync == SyncPolicy::Data) {
+#if defined(__APPLE__)
+            ok = fsync(fd) == 0;
+#else
+            ok = fdatasync(fd) == 0;
+#endif
+        }
+        return ::close(fd) == 0 && ok;
+#else
+        (void)preallocate;
+        (void)sync;
+        std::ofstream file(filename, std::ios::binary);
+        for (size_t i = 0; file && i < count; ++i) {
+            file.write(static_cast<const char*>(parts[i].data), static_cast<std::streamsize>(parts[i].size));
+        }
+        file.close();
+        return !file.fail();
+#endif
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <string>
+#include <cstddef>
+
+namespace nanocbf {
+
+// A piece of a file written by writeFile
+struct FilePart {
+    const void* data;
+    size_t size;
+};
+
+// Whether writing a file waits until it has reached the disk
+enum class SyncPolicy {
+    None,   // Leave it to the OS (default)
+    Data,   // fdatasync: the contents and size are on disk
+    Full    // fsync: metadata such as timestamps too
+};
+
+// Create or truncate filename and write parts in order with a single
+// gather write (writev on POSIX, repeated only if the OS writes less).
+// With preallocate the total size is reserved first (fallocate on Linux,
+// ignored elsewhere), so the filesystem can allocate it in one go.
+bool writeFile(const std::string& filename, const FilePart* parts, size_t count,
+               bool preallocate = false, SyncPolicy sync = SyncPolicy::None);
+
+} // namespace nanocbf
+
+#endif // FILEWRITER_H
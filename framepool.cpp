@@ -0,0 +1,58 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "framepool.h"
+
+namespace nanocbf {
+
+    FramePool::FramePool(size_t maxFrames) : m_maxFrames(maxFrames) {
+        // Never grow later, so release() does not allocate either
+        m_frames.reserve(maxFrames);
+    }
+
+    CBFFrame FramePool::acquire() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_frames.empty()) {
+            return CBFFrame();
+        }
+
+        CBFFrame frame(std::move(m_frames.back()));
+        m_frames.pop_back();
+        return frame;
+    }
+
+    void FramePool::release(CBFFrame&& frame) {
+        frame.clear();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_frames.size() < m_maxFrames) {
+            m_frames.push_back(std::move(frame));
+        }
+    }
+
+    size_t FramePool::size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frames.size();
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <vector>
+#include <mutex>
+#include "cbfframe.h"
+
+namespace nanocbf {
+
+// Keeps frames that are no longer needed so that reading the next frame
+// reuses their pixel and scratch buffers instead of allocating new ones.
+// Once the pool is warm, reading same-sized frames allocates nothing.
+class FramePool {
+public:
+    // At most maxFrames released frames are kept; any beyond that are freed
+    explicit FramePool(size_t maxFrames = 8);
+
+    // A released frame (empty, but with its buffers) or a new frame if the pool is empty
+    CBFFrame acquire();
+
+    // Give a frame back to the pool. Thread safe, like acquire().
+    void release(CBFFrame&& frame);
+
+    // Frames currently held
+    size_t size() const;
+
+private:
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+    std::vector<CBFFrame> m_frames;
+    size_t m_maxFrames;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace nanocbf
+
+#endif // FRAMEPOOL_H
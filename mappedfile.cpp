@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mappedfile.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NANOCBF_HAVE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace nanocbf {
+
+    MappedFile::MappedFile(std::vector<uint8_t>* buffer)
+        : m_data(nullptr), m_size(0), m_mapped(false), m_storage(buffer ? buffer : &m_buffer) {}
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool MappedFile::open(const std::string& filename, FileAccess access) {
+        close();
+
+#ifdef NANOCBF_HAVE_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (st.st_size == 0) {
+                ::close(fd);
+                return true;
+            }
+
+            void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::close(fd);
+                m_data = static_cast<const uint8_t*>(addr);
+                m_size = static_cast<size_t>(st.st_size);
+                m_mapped = true;
+                advise(access);
+                return true;
+            }
+        }
+        ::close(fd);
+#endif
+
+        // Fallback: read the whole file into the buffer
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file.seekg(0, std::ios::end);
+        std::streamoff length = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (length > 0) {
+            m_storage->resize(static_cast<size_t>(length));
+            file.read(reinterpret_cast<char*>(m_storage->data()), length);
+            m_storage->resize(static_cast<size_t>(file.gcount()));
+        }
+
+        m_data = m_storage->data();
+        m_size = m_storage->size();
+        return true;
+    }
+
+    void MappedFile::close() {
+#ifdef NANOCBF_HAVE_MMAP
+        if (m_mapped) {
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
+        if (m_storage == &m_buffer) {
+            std::vector<uint8_t>().swap(m_buffer);
+        } else {
+            m_storage->clear();
+        }
+    }
+
+    void MappedFile::advise(FileAccess access) {
+#ifdef NANOCBF_HAVE_MMAP
+        if (!m_mapped) {
+            return;
+        }
+        int advice = MADV_NORMAL;
+        if (access == FileAccess::Sequential) {
+            advice = MADV_SEQUENTIAL;
+        } else if (access == FileAccess::Random) {
+            advice = MADV_RANDOM;
+        }
+        madvise(const_cast<uint8_t*>(m_data), m_size, advice);
+#else
+        (void)access;
+#endif
+    }
+}
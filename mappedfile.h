@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace nanocbf {
+
+// How a mapped file is going to be read, passed to the kernel as a hint
+enum class FileAccess {
+    Normal,         // No hint, e.g. a part of the file or several threads at once
+    Sequential,     // Front to back exactly once
+    Random          // A few pages here and there, e.g. only the header
+};
+
+// Read-only view of a whole file. Uses mmap on POSIX systems and falls back
+// to reading the file into a buffer elsewhere (or if mapping fails).
+class MappedFile {
+public:
+    // The fallback path reads into buffer if given, so its capacity can be
+    // reused across files; otherwise into a buffer owned by this object
+    explicit MappedFile(std::vector<uint8_t>* buffer = nullptr);
+    ~MappedFile();
+
+    // Map (or read) the file; returns false if it could not be opened
+    bool open(const std::string& filename, FileAccess access = FileAccess::Normal);
+    void close();
+
+    // Change the access hint of an open mapping; a no-op for the fallback path
+    void advise(FileAccess access);
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<uint8_t> m_buffer;  // Used by the fallback path only
+    std::vector<uint8_t>* m_storage; // Where the fallback path reads to
+};
+
+} // namespace nanocbf
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,210 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "md5.h"
+#include <cstring>
+#include <algorithm>
+
+namespace nanocbf {
+
+    // The rounds are fully unrolled, with each step's function and shift
+    // fixed at compile time
+
+    static inline uint32_t rotateLeft(uint32_t a, int s) { return (a << s) | (a >> (32 - s)); }
+
+    // Auxiliary functions F, G, H and I of the four rounds
+    template <int Round> struct MD5Round;
+
+    template <> struct MD5Round<0> {
+        static inline uint32_t f(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
+    };
+
+    template <> struct MD5Round<1> {
+        static inline uint32_t f(uint32_t x, uint32_t y, uint32_t z) { return y ^ (z & (x ^ y)); }
+    };
+
+    template <> struct MD5Round<2> {
+        static inline uint32_t f(uint32_t x, uint32_t y, uint32_t z) { return x ^ y ^ z; }
+    };
+
+    template <> struct MD5Round<3> {
+        static inline uint32_t f(uint32_t x, uint32_t y, uint32_t z) { return y ^ (x | ~z); }
+    };
+
+    // a = b + ((a + f(b, c, d) + x + k) <<< S)
+    template <int Round, int S>
+    static inline void md5Step(uint32_t& a, uint32_t b, uint32_t c, uint32_t d, uint32_t x, uint32_t k) {
+        a = b + rotateLeft(a + MD5Round<Round>::f(b, c, d) + x + k, S);
+    }
+
+    // All 64 steps of one block on the message words x
+    static inline void md5Rounds(uint32_t state[4], const uint32_t x[16]) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+        md5Step<0,  7>(a, b, c, d, x[ 0], 0xd76aa478);
+        md5Step<0, 12>(d, a, b, c, x[ 1], 0xe8c7b756);
+        md5Step<0, 17>(c, d, a, b, x[ 2], 0x242070db);
+        md5Step<0, 22>(b, c, d, a, x[ 3], 0xc1bdceee);
+        md5Step<0,  7>(a, b, c, d, x[ 4], 0xf57c0faf);
+        md5Step<0, 12>(d, a, b, c, x[ 5], 0x4787c62a);
+        md5Step<0, 17>(c, d, a, b, x[ 6], 0xa8304613);
+        md5Step<0, 22>(b, c, d, a, x[ 7], 0xfd469501);
+        md5Step<0,  7>(a, b, c, d, x[ 8], 0x698098d8);
+        md5Step<0, 12>(d, a, b, c, x[ 9], 0x8b44f7af);
+        md5Step<0, 17>(c, d, a, b, x[10], 0xffff5bb1);
+        md5Step<0, 22>(b, c, d, a, x[11], 0x895cd7be);
+        md5Step<0,  7>(a, b, c, d, x[12], 0x6b901122);
+        md5Step<0, 12>(d, a, b, c, x[13], 0xfd987193);
+        md5Step<0, 17>(c, d, a, b, x[14], 0xa679438e);
+        md5Step<0, 22>(b, c, d, a, x[15], 0x49b40821);
+
+        md5Step<1,  5>(a, b, c, d, x[ 1], 0xf61e2562);
+        md5Step<1,  9>(d, a, b, c, x[ 6], 0xc040b340);
+        md5Step<1, 14>(c, d, a, b, x[11], 0x265e5a51);
+        md5Step<1, 20>(b, c, d, a, x[ 0], 0xe9b6c7aa);
+        md5Step<1,  5>(a, b, c, d, x[ 5], 0xd62f105d);
+        md5Step<1,  9>(d, a, b, c, x[10], 0x02441453);
+        md5Step<1, 14>(c, d, a, b, x[15], 0xd8a1e681);
+        md5Step<1, 20>(b, c, d, a, x[ 4], 0xe7d3fbc8);
+        md5Step<1,  5>(a, b, c, d, x[ 9], 0x21e1cde6);
+        md5Step<1,  9>(d, a, b, c, x[14], 0xc33707d6);
+        md5Step<1, 14>(c, d, a, b, x[ 3], 0xf4d50d87);
+        md5Step<1, 20>(b, c, d, a, x[ 8], 0x455a14ed);
+        md5Step<1,  5>(a, b, c, d, x[13], 0xa9e3e905);
+        md5Step<1,  9>(d, a, b, c, x[ 2], 0xfcefa3f8);
+        md5Step<1, 14>(c, d, a, b, x[ 7], 0x676f02d9);
+        md5Step<1, 20>(b, c, d, a, x[12], 0x8d2a4c8a);
+
+        md5Step<2,  4>(a, b, c, d, x[ 5], 0xfffa3942);
+        md5Step<2, 11>(d, a, b, c, x[ 8], 0x8771f681);
+        md5Step<2, 16>(c, d, a, b, x[11], 0x6d9d6122);
+        md5Step<2, 23>(b, c, d, a, x[14], 0xfde5380c);
+        md5Step<2,  4>(a, b, c, d, x[ 1], 0xa4beea44);
+        md5Step<2, 11>(d, a, b, c, x[ 4], 0x4bdecfa9);
+        md5Step<2, 16>(c, d, a, b, x[ 7], 0xf6bb4b60);
+        md5Step<2, 23>(b, c, d, a, x[10], 0xbebfbc70);
+        md5Step<2,  4>(a, b, c, d, x[13], 0x289b7ec6);
+        md5Step<2, 11>(d, a, b, c, x[ 0], 0xeaa127fa);
+        md5Step<2, 16>(c, d, a, b, x[ 3], 0xd4ef3085);
+        md5Step<2, 23>(b, c, d, a, x[ 6], 0x04881d05);
+        md5Step<2,  4>(a, b, c, d, x[ 9], 0xd9d4d039);
+        md5Step<2, 11>(d, a, b, c, x[12], 0xe6db99e5);
+        md5Step<2, 16>(c, d, a, b, x[15], 0x1fa27cf8);
+        md5Step<2, 23>(b, c, d, a, x[ 2], 0xc4ac5665);
+
+        md5Step<3,  6>(a, b, c, d, x[ 0], 0xf4292244);
+        md5Step<3, 10>(d, a, b, c, x[ 7], 0x432aff97);
+        md5Step<3, 15>(c, d, a, b, x[14], 0xab9423a7);
+        md5Step<3, 21>(b, c, d, a, x[ 5], 0xfc93a039);
+        md5Step<3,  6>(a, b, c, d, x[12], 0x655b59c3);
+        md5Step<3, 10>(d, a, b, c, x[ 3], 0x8f0ccc92);
+        md5Step<3, 15>(c, d, a, b, x[10], 0xffeff47d);
+        md5Step<3, 21>(b, c, d, a, x[ 1], 0x85845dd1);
+        md5Step<3,  6>(a, b, c, d, x[ 8], 0x6fa87e4f);
+        md5Step<3, 10>(d, a, b, c, x[15], 0xfe2ce6e0);
+        md5Step<3, 15>(c, d, a, b, x[ 6], 0xa3014314);
+        md5Step<3, 21>(b, c, d, a, x[13], 0x4e0811a1);
+        md5Step<3,  6>(a, b, c, d, x[ 4], 0xf7537e82);
+        md5Step<3, 10>(d, a, b, c, x[11], 0xbd3af235);
+        md5Step<3, 15>(c, d, a, b, x[ 2], 0x2ad7d2bb);
+        md5Step<3, 21>(b, c, d, a, x[ 9], 0xeb86d391);
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+
+    // Hash blockCount consecutive 64-byte blocks
+    static void md5Blocks(uint32_t state[4], const uint8_t* blocks, size_t blockCount) {
+        for (size_t n = 0; n < blockCount; ++n, blocks += 64) {
+            uint32_t x[16];
+            for (int i = 0; i < 16; ++i) {
+                x[i] = static_cast<uint32_t>(blocks[i*4]) | (static_cast<uint32_t>(blocks[i*4+1]) << 8) |
+                       (static_cast<uint32_t>(blocks[i*4+2]) << 16) | (static_cast<uint32_t>(blocks[i*4+3]) << 24);
+            }
+            md5Rounds(state, x);
+        }
+    }
+
+    MD5State::MD5State() : count(0) {
+        state[0] = 0x67452301;
+        state[1] = 0xEFCDAB89;
+        state[2] = 0x98BADCFE;
+        state[3] = 0x10325476;
+        std::memset(buffer, 0, sizeof(buffer));
+    }
+
+    void md5Update(MD5State& md5, const uint8_t* input, size_t length) {
+        if (length == 0) {
+            return;
+        }
+
+        size_t bufferIndex = md5.count % 64;
+        md5.count += length;
+
+        // Complete a partial block first
+        if (bufferIndex > 0) {
+            size_t fill = std::min(length, 64 - bufferIndex);
+            std::memcpy(md5.buffer + bufferIndex, input, fill);
+            input += fill;
+            length -= fill;
+            if (bufferIndex + fill < 64) {
+                return;
+            }
+            md5Blocks(md5.state, md5.buffer, 1);
+        }
+
+        // Whole blocks straight from the input, then keep the remainder
+        md5Blocks(md5.state, input, length / 64);
+        std::memcpy(md5.buffer, input + (length / 64) * 64, length % 64);
+    }
+
+    void md5Final(MD5State& md5, uint8_t digest[16]) {
+        size_t bufferIndex = md5.count % 64;
+        md5.buffer[bufferIndex++] = 0x80;
+
+        if (bufferIndex > 56) {
+            std::memset(md5.buffer + bufferIndex, 0, 64 - bufferIndex);
+            md5Blocks(md5.state, md5.buffer, 1);
+            bufferIndex = 0;
+        }
+
+        std::memset(md5.buffer + bufferIndex, 0, 56 - bufferIndex);
+
+        uint64_t bitCount = md5.count * 8;
+        for (int i = 0; i < 8; ++i) {
+            md5.buffer[56 + i] = (bitCount >> (i * 8)) & 0xFF;
+        }
+
+        md5Blocks(md5.state, md5.buffer, 1);
+
+        for (int i = 0; i < 4; ++i) {
+            digest[i*4]     = (md5.state[i]) & 0xFF;
+            digest[i*4 + 1] = (md5.state[i] >> 8) & 0xFF;
+            digest[i*4 + 2] = (md5.state[i] >> 16) & 0xFF;
+            digest[i*4 + 3] = (md5.state[i] >> 24) & 0xFF;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MD5_H
+#define MD5_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace nanocbf {
+
+// Incremental MD5 (RFC 1321) state
+struct MD5State {
+    uint32_t state[4];
+    uint64_t count;       // Bytes hashed so far
+    uint8_t buffer[64];   // Partial block
+
+    MD5State();
+};
+
+// Hash length more bytes
+void md5Update(MD5State& md5, const uint8_t* input, size_t length);
+
+// Pad, finish and write the 16-byte digest; md5 must not be updated afterwards
+void md5Final(MD5State& md5, uint8_t digest[16]);
+
+} // namespace nanocbf
+
+#endif // MD5_H
@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stats.h"
+#include <atomic>
+
+namespace nanocbf {
+
+    namespace {
+
+    // Global totals; each field is updated on its own, so a snapshot taken
+    // while frames are being read may mix calls
+    struct GlobalStage {
+        std::atomic<uint64_t> nanoseconds;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> count;
+    };
+
+    GlobalStage g_stages[STAGE_COUNT];
+
+    } // namespace
+
+    const char* stageName(Stage stage) {
+        switch (stage) {
+            case Stage::Read: return "read";
+            case Stage::Parse: return "parse";
+            case Stage::Decode: return "decode";
+            case Stage::Hash: return "hash";
+            case Stage::Compress: return "compress";
+            case Stage::Write: return "write";
+        }
+        return "unknown";
+    }
+
+    Stats globalStats() {
+        Stats stats;
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            stats.stages[i].nanoseconds = g_stages[i].nanoseconds.load(std::memory_order_relaxed);
+            stats.stages[i].bytes = g_stages[i].bytes.load(std::memory_order_relaxed);
+            stats.stages[i].count = g_stages[i].count.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    void resetGlobalStats() {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            g_stages[i].nanoseconds.store(0, std::memory_order_relaxed);
+            g_stages[i].bytes.store(0, std::memory_order_relaxed);
+            g_stages[i].count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void addGlobalStats(const Stats& stats) {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            if (stats.stages[i].count != 0) {
+                g_stages[i].nanoseconds.fetch_add(stats.stages[i].nanoseconds, std::memory_order_relaxed);
+                g_stages[i].bytes.fetch_add(stats.stages[i].bytes, std::memory_order_relaxed);
+                g_stages[i].count.fetch_add(stats.stages[i].count, std::memory_order_relaxed);
+            }
+        }
+    }
+}
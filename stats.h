@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2025 Arkadiy Simonov and Vadim Dyadkin
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NANOCBF_STATS_H
+#define NANOCBF_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#ifdef NANOCBF_STATS
+#include <chrono>
+#endif
+
+namespace nanocbf {
+
+// Stages of reading and writing a frame that time and bytes are recorded for
+enum class Stage {
+    Read,       // Opening or reading the file (with mmap, page faults fall to the consumer)
+    Parse,      // Locating header, MIME block and payload
+    Decode,     // Decompressing the payload
+    Hash,       // MD5 of the payload
+    Compress,   // Compressing pixels
+    Write       // Writing the file or stream
+};
+
+static const int STAGE_COUNT = 6;
+
+// Name of a stage, e.g. "decode"
+const char* stageName(Stage stage);
+
+struct StageStats {
+    uint64_t nanoseconds;
+    uint64_t bytes;
+    uint64_t count;     // Times the stage ran
+
+    StageStats() : nanoseconds(0), bytes(0), count(0) {}
+};
+
+// Time and bytes per stage. Only recorded if the library is built with
+// NANOCBF_STATS (cmake -DNANOCBF_STATS=ON); otherwise everything stays 0 and
+// the instrumentation compiles to nothing.
+struct Stats {
+    StageStats stages[STAGE_COUNT];
+
+    StageStats& operator[](Stage stage) { return stages[static_cast<int>(stage)]; }
+    const StageStats& operator[](Stage stage) const { return stages[static_cast<int>(stage)]; }
+
+    void clear() {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            stages[i] = StageStats();
+        }
+    }
+};
+
+// Whether the library records stats
+inline bool statsEnabled() {
+#ifdef NANOCBF_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Totals over all calls of all frames and threads since the last reset
+Stats globalStats();
+void resetGlobalStats();
+void addGlobalStats(const Stats& stats);
+
+#ifdef NANOCBF_STATS
+
+// Adds the time until it goes out of scope, and bytes, to one stage
+class StageTimer {
+public:
+    StageTimer(Stats& stats, Stage stage, uint64_t bytes)
+        : m_stage(stats[stage]), m_start(std::chrono::steady_clock::now()) {
+        m_stage.bytes += bytes;
+        ++m_stage.count;
+    }
+
+    ~StageTimer() {
+        m_stage.nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count());
+    }
+
+private:
+    StageStats& m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Scope of a public call: the outermost one clears stats on entry and adds
+// them to the global totals on exit
+class StatsCall {
+public:
+    StatsCall(Stats& stats, int& depth) : m_stats(stats), m_depth(depth) {
+        if (m_depth++ == 0) {
+            m_stats.clear();
+        }
+    }
+
+    ~StatsCall() {
+        if (--m_depth == 0) {
+            addGlobalStats(m_stats);
+        }
+    }
+
+private:
+    Stats& m_stats;
+    int& m_depth;
+};
+
+#define NANOCBF_STATS_CONCAT2(a, b) a##b
+#define NANOCBF_STATS_CONCAT(a, b) NANOCBF_STATS_CONCAT2(a, b)
+#define NANOCBF_STAGE(stats, stage, bytes) \
+    ::nanocbf::StageTimer NANOCBF_STATS_CONCAT(stageTimer, __LINE__)((stats), (stage), (bytes))
+#define NANOCBF_STATS_CALL(stats, depth) \
+    ::nanocbf::StatsCall NANOCBF_STATS_CONCAT(statsCall, __LINE__)((stats), (depth))
+// Add bytes to a stage that already ran, once they are known
+#define NANOCBF_STAGE_BYTES(stats, stage, amount) \
+    do { (stats)[stage].bytes += (amount); } while (0)
+
+#else
+
+#define NANOCBF_STAGE(stats, stage, bytes) do { (void)sizeof(stats); } while (0)
+#define NANOCBF_STAGE_BYTES(stats, stage, amount) do { (void)sizeof(stats); } while (0)
+#define NANOCBF_STATS_CALL(stats, depth) do { (void)sizeof(stats); } while (0)
+
+#endif
+
+} // namespace nanocbf
+
+#endif // NANOCBF_STATS_H
@@ -0,0 +1,774 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include "cbfframe.h"
+#include "md5.h"
+#include "cbfheader.h"
+#include "cbfseries.h"
+#include "filereader.h"
+
+// Run with a test name to run only that test; ctest runs them one by one
+
+#ifndef NANOCBF_TEST_DATA
+#define NANOCBF_TEST_DATA "test_data"
+#endif
+
+#if defined(NANOCBF_HAVE_IO_URING) && defined(__GLIBC__)
+#define NANOCBF_TEST_IO_FAULTS 1
+#include <cerrno>
+#include <cstdarg>
+#include <dlfcn.h>
+#include <sys/syscall.h>
+#endif
+
+static int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            ++g_failures; \
+        } \
+    } while (0)
+
+// Frame of width x height pixels with a spread of byte-offset deltas
+static nanocbf::CBFFrame makeFrame(int width, int height) {
+    nanocbf::CBFFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.data.resize(static_cast<size_t>(width) * static_cast<size_t>(height));
+    for (size_t i = 0; i < frame.data.size(); ++i) {
+        frame.data[i] = static_cast<int32_t>((i * 2654435761u) % 100000);
+    }
+    return frame;
+}
+
+static std::string fileContents(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::ostringstream oss;
+    oss << file.rdbuf();
+    return oss.str();
+}
+
+static void saveFile(const std::string& filename, const std::string& contents) {
+    std::ofstream file(filename, std::ios::binary);
+    file << contents;
+}
+
+static std::string md5Hex(const std::string& input, size_t step) {
+    nanocbf::MD5State md5;
+    for (size_t i = 0; i < input.size(); i += step) {
+        nanocbf::md5Update(md5, reinterpret_cast<const uint8_t*>(input.data()) + i, std::min(step, input.size() - i));
+    }
+    uint8_t digest[16];
+    nanocbf::md5Final(md5, digest);
+
+    static const char hex[] = "0123456789abcdef";
+    std::string text;
+    for (int i = 0; i < 16; ++i) {
+        text += hex[digest[i] >> 4];
+        text += hex[digest[i] & 0xF];
+    }
+    return text;
+}
+
+static void testMD5() {
+    // RFC 1321 test suite, fed whole and in uneven pieces
+    CHECK(md5Hex("", 1) == "d41d8cd98f00b204e9800998ecf8427e");
+    CHECK(md5Hex("abc", 1) == "900150983cd24fb0d6963f7d28e17f72");
+    std::string digits;
+    for (int i = 0; i < 8; ++i) {
+        digits += "1234567890";
+    }
+    for (size_t step = 1; step <= 80; step += 7) {
+        CHECK(md5Hex(digits, step) == "57edf4a22be3c955ac49da2e2107b67a");
+    }
+}
+
+static void testIntegrity() {
+    // Async hashing on writes of growing frames, some with a row index, so
+    // the encode scratch buffer is reallocated under the hasher
+    for (int width = 100; width < 1400; width += 97) {
+        nanocbf::CBFFrame frame = makeFrame(width, width / 2 + 3);
+        frame.rowIndexRows = (width / 97) % 3 == 0 ? 0 : 16;
+        frame.integrity = nanocbf::IntegrityPolicy::Async;
+        CHECK(frame.write("nanocbf_test_integrity.cbf"));
+
+        nanocbf::CBFFrame readBack;
+        readBack.integrity = nanocbf::IntegrityPolicy::Verify;
+        CHECK(readBack.read("nanocbf_test_integrity.cbf"));
+        CHECK(readBack.data == frame.data);
+    }
+
+    // A digest that does not match the payload is only caught by Verify
+    std::string contents = fileContents("nanocbf_test_integrity.cbf");
+    size_t digest = contents.find("Content-MD5: ");
+    CHECK(digest != std::string::npos);
+    char& first = contents[digest + std::strlen("Content-MD5: ")];
+    first = first == 'A' ? 'B' : 'A';
+    saveFile("nanocbf_test_integrity.cbf", contents);
+
+    nanocbf::CBFFrame ignored;
+    CHECK(ignored.read("nanocbf_test_integrity.cbf"));
+    nanocbf::CBFFrame verified;
+    verified.integrity = nanocbf::IntegrityPolicy::Verify;
+    CHECK(!verified.read("nanocbf_test_integrity.cbf"));
+    CHECK(!verified.getError().empty());
+}
+
+template <typename Frame>
+static bool readsAs(const std::string& filename) {
+    Frame frame;
+    return frame.read(filename);
+}
+
+template <typename Frame>
+static void checkRoundTrip(const std::string& filename, typename Frame::value_type low, typename Frame::value_type high) {
+    Frame frame;
+    frame.width = 4;
+    frame.height = 2;
+    typedef typename Frame::value_type T;
+    T values[] = {low, high, 0, 1, high, low, static_cast<T>(high - 1), static_cast<T>(low + 1)};
+    frame.data.assign(values, values + 8);
+    CHECK(frame.write(filename));
+
+    Frame readBack;
+    CHECK(readBack.read(filename));
+    CHECK(readBack.data == frame.data);
+}
+
+static void testElementTypes() {
+    checkRoundTrip<nanocbf::CBFFrameU16>("nanocbf_test_u16.cbf", 0, 65535);
+    checkRoundTrip<nanocbf::CBFFrameI16>("nanocbf_test_i16.cbf", -32768, 32767);
+    checkRoundTrip<nanocbf::CBFFrameU32>("nanocbf_test_u32.cbf", 0, 4294967295u);
+    checkRoundTrip<nanocbf::CBFFrame>("nanocbf_test_i32.cbf", -2147483647 - 1, 2147483647);
+
+    // A file reads into any pixel type that holds every value of its element
+    // type, sign included, and into no other
+    CHECK(readsAs<nanocbf::CBFFrame>("nanocbf_test_u16.cbf"));
+    CHECK(readsAs<nanocbf::CBFFrameU32>("nanocbf_test_u16.cbf"));
+    CHECK(!readsAs<nanocbf::CBFFrameI16>("nanocbf_test_u16.cbf"));
+    CHECK(readsAs<nanocbf::CBFFrame>("nanocbf_test_i16.cbf"));
+    CHECK(!readsAs<nanocbf::CBFFrameU16>("nanocbf_test_i16.cbf"));
+    CHECK(!readsAs<nanocbf::CBFFrameU32>("nanocbf_test_i16.cbf"));
+    CHECK(!readsAs<nanocbf::CBFFrame>("nanocbf_test_u32.cbf"));
+    CHECK(!readsAs<nanocbf::CBFFrameI16>("nanocbf_test_i32.cbf"));
+}
+
+static size_t g_geometryCalls = 0;
+
+static size_t countingDecoder(const uint8_t* compressed, size_t size, int32_t* out) {
+    ++g_geometryCalls;
+    nanocbf::ByteOffsetState state;
+    return nanocbf::decodeByteOffset(compressed, size, state, out, 37 * 11);
+}
+
+static void testGeometryDecoder() {
+    nanocbf::CBFFrame frame = makeFrame(37, 11);
+    CHECK(frame.write("nanocbf_test_geometry.cbf"));
+    nanocbf::CBFFrame other = makeFrame(11, 37);
+    CHECK(other.write("nanocbf_test_geometry_other.cbf"));
+
+    nanocbf::registerByteOffsetDecoder(37, 11, countingDecoder);
+    CHECK(nanocbf::byteOffsetDecoderFor(37, 11) == countingDecoder);
+    CHECK(nanocbf::byteOffsetDecoderFor(11, 37) == nullptr);
+
+    // Only frames of the registered geometry go through the decoder
+    nanocbf::CBFFrame readBack;
+    CHECK(readBack.read("nanocbf_test_geometry.cbf"));
+    CHECK(readBack.data == frame.data);
+    CHECK(g_geometryCalls == 1);
+    CHECK(readBack.read("nanocbf_test_geometry_other.cbf"));
+    CHECK(readBack.data == other.data);
+    CHECK(g_geometryCalls == 1);
+
+    nanocbf::registerByteOffsetDecoder(37, 11, nullptr);
+    CHECK(nanocbf::byteOffsetDecoderFor(37, 11) == nullptr);
+    CHECK(readBack.read("nanocbf_test_geometry.cbf"));
+    CHECK(g_geometryCalls == 1);
+}
+
+// What read(filename, float*, ...) should give for one raw value
+static float corrected(double raw, size_t i, const nanocbf::PixelCorrection& correction) {
+    if ((correction.mask && correction.mask[i]) || (correction.maskNegative && raw < 0)) {
+        return correction.maskedValue;
+    }
+    float value = static_cast<float>(raw);
+    if (correction.offset) {
+        value -= correction.offset[i];
+    }
+    if (correction.gain) {
+        value *= correction.gain[i];
+    }
+    return value;
+}
+
+static void testFloatCorrection() {
+    // Large enough for the parallel decode, with gaps and bad pixels
+    nanocbf::CBFFrame frame = makeFrame(1100, 1000);
+    for (size_t i = 0; i < frame.data.size(); i += 997) {
+        frame.data[i] = i % 2 ? -1 : -2;
+    }
+    CHECK(frame.write("nanocbf_test_float.cbf"));
+
+    size_t count = frame.data.size();
+    std::vector<float> offset(count), gain(count);
+    std::vector<uint8_t> mask(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        offset[i] = static_cast<float>(i % 13);
+        gain[i] = i % 3 ? 0.5f : 2.0f;
+        mask[i] = i % 101 == 0;
+    }
+    nanocbf::PixelCorrection correction;
+    correction.offset = offset.data();
+    correction.gain = gain.data();
+    correction.mask = mask.data();
+    correction.maskedValue = -1000.0f;
+
+    std::vector<float> out(count);
+    for (int mode = 0; mode < 4; ++mode) {
+        nanocbf::CBFFrame reader;
+        reader.threads = mode == 1 ? 4 : 1;
+        reader.integrity = mode == 2 ? nanocbf::IntegrityPolicy::Verify : nanocbf::IntegrityPolicy::Compute;
+        correction.maskNegative = mode != 3;
+        CHECK(reader.read("nanocbf_test_float.cbf", out.data(), out.size(), correction));
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < count; ++i) {
+            wrong += out[i] != corrected(frame.data[i], i, correction);
+        }
+        CHECK(wrong == 0);
+    }
+    nanocbf::CBFFrame reader;
+    CHECK(!reader.read("nanocbf_test_float.cbf", out.data(), count - 1, correction));
+
+    // Unsigned 32-bit values above 2^31 are neither negative nor masked
+    nanocbf::CBFFrameU32 unsignedFrame;
+    unsignedFrame.width = 3;
+    unsignedFrame.height = 2;
+    uint32_t values[] = {0u, 2147483647u, 2147483648u, 3000000000u, 4294967295u, 123u};
+    unsignedFrame.data.assign(values, values + 6);
+    CHECK(unsignedFrame.write("nanocbf_test_float_u32.cbf"));
+
+    nanocbf::PixelCorrection plain;
+    CHECK(reader.read("nanocbf_test_float_u32.cbf", out.data(), out.size(), plain));
+    for (size_t i = 0; i < 6; ++i) {
+        CHECK(out[i] == static_cast<float>(values[i]));
+    }
+}
+
+// Region of frame summed in bin x bin blocks, the slow way
+static std::vector<int32_t> expectedRegion(const nanocbf::CBFFrame& frame, const nanocbf::DecodeRegion& region) {
+    std::vector<int32_t> out(region.outputWidth() * region.outputHeight(), 0);
+    for (size_t row = 0; row < region.outputHeight() * region.bin; ++row) {
+        for (size_t column = 0; column < region.outputWidth() * region.bin; ++column) {
+            size_t pixel = (region.y + row) * static_cast<size_t>(frame.width) + region.x + column;
+            out[(row / region.bin) * region.outputWidth() + column / region.bin] += frame.data[pixel];
+        }
+    }
+    return out;
+}
+
+static void testRegion() {
+    nanocbf::CBFFrame frame = makeFrame(257, 190);
+    for (int rowIndexRows = 0; rowIndexRows <= 16; rowIndexRows += 16) {
+        frame.rowIndexRows = rowIndexRows;
+        CHECK(frame.write("nanocbf_test_region.cbf"));
+
+        nanocbf::DecodeRegion regions[] = {
+            nanocbf::DecodeRegion(0, 0, 257, 190),
+            nanocbf::DecodeRegion(10, 37, 100, 50),
+            nanocbf::DecodeRegion(200, 150, 57, 40),
+            nanocbf::DecodeRegion(0, 189, 257, 1),
+            nanocbf::DecodeRegion(5, 3, 250, 187, 2),
+            nanocbf::DecodeRegion(1, 100, 64, 63, 4),
+            nanocbf::DecodeRegion(256, 0, 1, 190, 1),
+            nanocbf::DecodeRegion(3, 3, 2, 2, 3),
+        };
+        for (size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); ++i) {
+            std::vector<int32_t> expected = expectedRegion(frame, regions[i]);
+            std::vector<int32_t> out(expected.size() + 1, -7);
+            nanocbf::CBFFrame reader;
+            CHECK(reader.readRegion("nanocbf_test_region.cbf", regions[i], out.data(), out.size()));
+            CHECK(std::equal(expected.begin(), expected.end(), out.begin()));
+            CHECK(reader.rowIndex.rowsPerEntry == static_cast<size_t>(rowIndexRows));
+        }
+    }
+
+    // Regions reaching past the frame, including ones whose end wraps around
+    std::vector<int32_t> out(257 * 190);
+    nanocbf::DecodeRegion outside[] = {
+        nanocbf::DecodeRegion(0, 0, 258, 1),
+        nanocbf::DecodeRegion(0, 185, 1, 6),
+        nanocbf::DecodeRegion(300, 0, 0, 1),
+        nanocbf::DecodeRegion(10, 0, static_cast<size_t>(-5), 1),
+        nanocbf::DecodeRegion(0, 10, 1, static_cast<size_t>(-5)),
+        nanocbf::DecodeRegion(0, 0, 4, 4, 0),
+    };
+    for (size_t i = 0; i < sizeof(outside) / sizeof(outside[0]); ++i) {
+        nanocbf::CBFFrame reader;
+        CHECK(!reader.readRegion("nanocbf_test_region.cbf", outside[i], out.data(), out.size()));
+    }
+    nanocbf::CBFFrame reader;
+    CHECK(!reader.readRegion("nanocbf_test_region.cbf", nanocbf::DecodeRegion(0, 0, 10, 10), out.data(), 99));
+}
+
+static std::string replaced(std::string text, const std::string& from, const std::string& to) {
+    size_t position = text.find(from);
+    CHECK(position != std::string::npos);
+    return position == std::string::npos ? text : text.replace(position, from.size(), to);
+}
+
+static void testBadRowIndex() {
+    // Large enough for the indexed parallel decode
+    nanocbf::CBFFrame frame = makeFrame(1100, 1000);
+    frame.rowIndexRows = 64;
+    std::vector<uint8_t> image;
+    CHECK(frame.encode("nanocbf_test_row_index.cbf", image));
+    std::string good(image.begin(), image.end());
+
+    // Start of the first three entry lines and of the closing ';' line
+    size_t entries = good.find("_nanocbf_row_index.entries");
+    CHECK(entries != std::string::npos);
+    size_t first = good.find('\n', good.find("\n;", entries) + 1) + 1;
+    size_t second = good.find('\n', first) + 1;
+    size_t third = good.find('\n', second) + 1;
+    size_t closing = good.find("\n;", third) + 1;
+    std::string firstEntry = good.substr(first, second - first);
+    std::string secondEntry = good.substr(second, third - second);
+    CHECK(firstEntry == "0 0\r\n");
+
+    std::vector<std::string> bad;
+    bad.push_back(replaced(good, "rows_per_entry 64", "rows_per_entry 0"));
+    bad.push_back(replaced(good, "rows_per_entry 64", "rows_per_entry -64"));
+    bad.push_back(replaced(good, "rows_per_entry 64", "rows_per_entry 32"));
+    bad.push_back(replaced(good, "rows_per_entry 64", "rows_per_entry x"));
+    bad.push_back(std::string(good).erase(first, closing - first));                        // No entries
+    bad.push_back(std::string(good).insert(third, "99999999999999999999999 5\r\n"));       // Overflowing position
+    bad.push_back(std::string(good).insert(third, "2 7\r\n"));                             // Out of order
+    bad.push_back(std::string(good).replace(first, third - first, secondEntry + firstEntry));
+    bad.push_back(std::string(good).erase(second, third - second));                        // One entry missing
+    bad.push_back(std::string(good).replace(first, second - first, "1 0\r\n"));           // First row not at 0
+
+    std::vector<int32_t> out(200 * 10);
+    for (size_t i = 0; i < bad.size(); ++i) {
+        // The index is ignored and the frame still decodes, on any number of threads
+        for (unsigned threads = 1; threads <= 4; threads += 3) {
+            nanocbf::CBFFrame reader;
+            reader.threads = threads;
+            CHECK(reader.decode(reinterpret_cast<const uint8_t*>(bad[i].data()), bad[i].size()));
+            CHECK(reader.rowIndex.rowsPerEntry == 0);
+            CHECK(reader.data == frame.data);
+        }
+
+        saveFile("nanocbf_test_row_index.cbf", bad[i]);
+        nanocbf::DecodeRegion region(300, 500, 200, 10);
+        nanocbf::CBFFrame reader;
+        CHECK(reader.readRegion("nanocbf_test_row_index.cbf", region, out.data(), out.size()));
+        CHECK(out == expectedRegion(frame, region));
+    }
+
+    nanocbf::CBFFrame reader;
+    CHECK(reader.decode(image.data(), image.size()));
+    CHECK(reader.rowIndex.rowsPerEntry == 64);
+}
+
+// Pixels whose deltas need 1, 2, 4 and (at the 32-bit wrap) every escape
+static std::vector<int32_t> mixedPixels(size_t count, std::mt19937& random) {
+    std::vector<int32_t> pixels(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t r = random();
+        switch (r % 4) {
+        case 0: pixels[i] = static_cast<int32_t>(r % 50); break;
+        case 1: pixels[i] = static_cast<int32_t>(r % 60000) - 30000; break;
+        case 2: pixels[i] = static_cast<int32_t>(r); break;
+        default: pixels[i] = i % 2 ? 2147483647 : -2147483647 - 1; break;
+        }
+    }
+    return pixels;
+}
+
+// Every decoder gives the scalar kernel's pixels for a damaged stream and
+// writes nothing past them
+static void checkDecoders(const std::vector<uint8_t>& stream, size_t count) {
+    std::vector<int32_t> reference(count);
+    nanocbf::ByteOffsetState state;
+    size_t decoded = nanocbf::decodeByteOffsetScalar(stream.data(), stream.size(), state, reference.data(), count);
+    CHECK(decoded <= count);
+    CHECK(state.pos <= stream.size());
+    reference.resize(decoded);
+
+    std::vector<int32_t> out(count + 16, 12345);
+    nanocbf::ByteOffsetState simdState;
+    CHECK(nanocbf::decodeByteOffset(stream.data(), stream.size(), simdState, out.data(), count) == decoded);
+    CHECK(simdState.pos == state.pos);
+    CHECK(std::equal(reference.begin(), reference.end(), out.begin()));
+    CHECK(std::count(out.begin() + decoded, out.end(), 12345) == static_cast<std::ptrdiff_t>(out.size() - decoded));
+
+    std::vector<int16_t> narrow(count + 16, 12345);
+    nanocbf::ByteOffsetState narrowState;
+    CHECK(nanocbf::decodeByteOffset(stream.data(), stream.size(), narrowState, narrow.data(), count) == decoded);
+    size_t narrowWrong = 0;
+    for (size_t i = 0; i < decoded; ++i) {
+        narrowWrong += narrow[i] != static_cast<int16_t>(reference[i]);
+    }
+    CHECK(narrowWrong == 0);
+    CHECK(std::count(narrow.begin() + decoded, narrow.end(), 12345) == static_cast<std::ptrdiff_t>(narrow.size() - decoded));
+
+    std::fill(out.begin(), out.end(), 12345);
+    CHECK(nanocbf::decodeByteOffsetParallel(stream.data(), stream.size(), out.data(), count, 3, 1000) == decoded);
+    CHECK(std::equal(reference.begin(), reference.end(), out.begin()));
+    CHECK(std::count(out.begin() + decoded, out.end(), 12345) == static_cast<std::ptrdiff_t>(out.size() - decoded));
+}
+
+static void testDamagedStream() {
+    std::mt19937 random(20250101);
+    for (int round = 0; round < 40; ++round) {
+        size_t count = 1 + random() % 20000;
+        std::vector<int32_t> pixels = mixedPixels(count, random);
+        std::vector<uint8_t> stream(nanocbf::byteOffsetMaxSize(count));
+        stream.resize(nanocbf::encodeByteOffset(pixels.data(), count, stream.data()));
+        checkDecoders(stream, count);
+
+        // Truncated anywhere, including inside an escape
+        for (int cut = 0; cut < 8; ++cut) {
+            std::vector<uint8_t> truncated(stream.begin(), stream.begin() + random() % stream.size());
+            checkDecoders(truncated, count);
+        }
+
+        // Random bytes overwritten, especially with escape markers
+        std::vector<uint8_t> corrupted = stream;
+        for (int flip = 0; flip < 10; ++flip) {
+            uint8_t values[] = {0x80, 0x00, 0x80, static_cast<uint8_t>(random())};
+            corrupted[random() % corrupted.size()] = values[flip % 4];
+        }
+        checkDecoders(corrupted, count);
+    }
+
+    // A truncated file fails to read instead of giving a short frame
+    nanocbf::CBFFrame frame = makeFrame(300, 200);
+    std::vector<uint8_t> image;
+    CHECK(frame.encode("nanocbf_test_damaged.cbf", image));
+    std::string contents(image.begin(), image.end());
+    size_t payload = contents.find("\x0c\x1a\x04\xd5");
+    CHECK(payload != std::string::npos);
+    saveFile("nanocbf_test_damaged.cbf", contents.substr(0, payload + 4 + 1000));
+    nanocbf::CBFFrame reader;
+    CHECK(!reader.read("nanocbf_test_damaged.cbf"));
+    CHECK(!reader.getError().empty());
+}
+
+// image with the value of one MIME header line replaced
+static std::string withHeaderValue(const std::string& image, const std::string& key, const std::string& value) {
+    size_t begin = image.find(key + ":");
+    CHECK(begin != std::string::npos);
+    if (begin == std::string::npos) {
+        return image;
+    }
+    size_t end = image.find("\r\n", begin);
+    return std::string(image).replace(begin, end - begin, key + ": " + value);
+}
+
+static void testBadMimeHeader() {
+    nanocbf::CBFFrame frame = makeFrame(1000, 1000);
+    std::vector<uint8_t> image;
+    CHECK(frame.encode("nanocbf_test_mime.cbf", image));
+    std::string good(image.begin(), image.end());
+
+    // Values that overflow, or wrap to plausible ones when narrowed
+    std::vector<std::string> bad;
+    bad.push_back(withHeaderValue(good, "X-Binary-Size", "18446744073709551615"));
+    bad.push_back(withHeaderValue(good, "X-Binary-Size", "99999999999999999999999"));
+    bad.push_back(withHeaderValue(good, "X-Binary-Size", "-1"));
+    bad.push_back(withHeaderValue(good, "X-Binary-Size-Fastest-Dimension", "4294968296"));
+    bad.push_back(withHeaderValue(good, "X-Binary-Size-Second-Dimension", "-1000"));
+    bad.push_back(withHeaderValue(good, "X-Binary-Element-Type", "\"signed 64-bit integer\""));
+
+    for (size_t i = 0; i < bad.size(); ++i) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(bad[i].data());
+        nanocbf::CBFFrame reader;
+        CHECK(!reader.decode(data, bad[i].size()));
+        CHECK(!reader.getError().empty());
+
+        std::vector<nanocbf::BinarySection> sections;
+        if (reader.findSections(data, bad[i].size(), sections)) {
+            CHECK(!sections.empty());
+            nanocbf::CBFFrame sectionReader;
+            CHECK(!sectionReader.decode(data, bad[i].size(), sections[0]));
+        }
+    }
+
+    // Padding only widens the search for the end of the section
+    std::string padded = withHeaderValue(good, "X-Binary-Size-Padding", "18446744073709551615");
+    nanocbf::CBFFrame reader;
+    CHECK(reader.decode(reinterpret_cast<const uint8_t*>(padded.data()), padded.size()));
+    CHECK(reader.data == frame.data);
+}
+
+static const std::string REFERENCE_FILE = NANOCBF_TEST_DATA "/Y-CORRECTIONS.cbf";
+
+// Files of different sizes, not multiples of the O_DIRECT alignment, whose
+// bytes depend on their position and file number
+static std::vector<std::string> makeByteFiles(size_t count) {
+    std::vector<std::string> filenames;
+    for (size_t i = 0; i < count; ++i) {
+        filenames.push_back("nanocbf_test_io_" + std::to_string(i) + ".bin");
+        std::string contents(50000 + i * 777, '\0');
+        for (size_t k = 0; k < contents.size(); ++k) {
+            contents[k] = static_cast<char>((k * 7 + i) & 0xFF);
+        }
+        saveFile(filenames.back(), contents);
+    }
+    return filenames;
+}
+
+// Whether every request holds the contents written by makeByteFiles
+static size_t wrongByteFiles(const std::vector<nanocbf::FileRequest>& requests) {
+    size_t wrong = 0;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        bool same = requests[i].ok && requests[i].buffer.size() == 50000 + i * 777;
+        for (size_t k = 0; same && k < requests[i].buffer.size(); ++k) {
+            same = requests[i].buffer.data()[k] == static_cast<uint8_t>((k * 7 + i) & 0xFF);
+        }
+        wrong += !same;
+    }
+    return wrong;
+}
+
+static void testIOBackends() {
+    nanocbf::CBFFrame reference;
+    CHECK(reference.read(REFERENCE_FILE));
+    CHECK(reference.width == 500 && reference.height == 500);
+
+    nanocbf::IOBackend backends[] = {nanocbf::IOBackend::Mapped, nanocbf::IOBackend::Blocking, nanocbf::IOBackend::IoUring};
+    std::vector<std::string> filenames = makeByteFiles(12);
+    for (size_t b = 0; b < 3; ++b) {
+        for (int direct = 0; direct < 2; ++direct) {
+            // Whole frames, twice so the reader and its buffer are reused
+            nanocbf::CBFFrame frame;
+            frame.io = backends[b];
+            frame.directIO = direct != 0;
+            frame.integrity = nanocbf::IntegrityPolicy::Verify;
+            CHECK(frame.read(REFERENCE_FILE) && frame.read(REFERENCE_FILE));
+            CHECK(frame.data == reference.data);
+
+            std::vector<int32_t> out(reference.data.size());
+            CHECK(frame.read(REFERENCE_FILE, out.data(), out.size()));
+            CHECK(out == reference.data);
+
+            nanocbf::CBFFrame copy = frame;
+            CHECK(copy.read(REFERENCE_FILE));
+            CHECK(copy.data == reference.data);
+
+            CHECK(!frame.read("nanocbf_test_missing.cbf"));
+            CHECK(!frame.getError().empty());
+
+            // Raw batches, with one missing file in the middle
+            std::unique_ptr<nanocbf::FileReader> reader = nanocbf::FileReader::create(backends[b], direct != 0, 5);
+            std::vector<nanocbf::FileRequest> requests(filenames.size());
+            for (int round = 0; round < 2; ++round) {
+                for (size_t i = 0; i < filenames.size(); ++i) {
+                    requests[i].filename = filenames[i];
+                }
+                CHECK(reader->read(requests.data(), requests.size()));
+                CHECK(wrongByteFiles(requests) == 0);
+            }
+            requests[4].filename = "nanocbf_test_missing.bin";
+            CHECK(!reader->read(requests.data(), requests.size()));
+            CHECK(!requests[4].ok && !requests[4].error.empty());
+            CHECK(requests[3].ok && requests[5].ok);
+
+            // A series read in batches gives the frames in order
+            std::vector<std::string> series(6, REFERENCE_FILE);
+            series[2] = "nanocbf_test_missing.cbf";
+            nanocbf::CBFSeries frames(series, 2, 4, backends[b], direct != 0);
+            size_t good = 0, failed = 0;
+            while (!frames.atEnd()) {
+                if (frames.next(frame)) {
+                    good += frame.data == reference.data;
+                } else {
+                    ++failed;
+                    CHECK(!frames.getError().empty());
+                }
+            }
+            CHECK(good == 5 && failed == 1);
+            CHECK(!frames.next(frame) && frames.getError().empty());
+        }
+    }
+}
+
+#ifdef NANOCBF_TEST_IO_FAULTS
+// io_uring_enter goes through syscall(); this one can make it submit part of
+// a batch or fail outright
+static int g_faultMode = 0;
+static int g_enterCalls = 0;
+
+extern "C" long syscall(long number, ...) {
+    va_list args;
+    va_start(args, number);
+    long a[6];
+    for (int i = 0; i < 6; ++i) {
+        a[i] = va_arg(args, long);
+    }
+    va_end(args);
+
+    typedef long (*Syscall)(long, ...);
+    static Syscall real = reinterpret_cast<Syscall>(dlsym(RTLD_NEXT, "syscall"));
+    if (number == __NR_io_uring_enter && g_faultMode > 0) {
+        ++g_enterCalls;
+        if (g_enterCalls == 1 && a[1] > 3) {
+            // Submit only 3 of the batch, without waiting in mode 3
+            a[1] = 3;
+            if (g_faultMode == 3) {
+                a[2] = 0;
+            }
+        } else if (g_enterCalls == 2) {
+            errno = g_faultMode == 2 ? EAGAIN : EFAULT;
+            return -1;
+        }
+    }
+    return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static void testIOUringFaults() {
+    std::vector<std::string> filenames = makeByteFiles(12);
+    for (g_faultMode = 0; g_faultMode < 4; ++g_faultMode) {
+        g_enterCalls = 0;
+        std::unique_ptr<nanocbf::FileReader> reader = nanocbf::FileReader::create(nanocbf::IOBackend::IoUring, false, 32);
+        // A short or failed submission falls back without losing a file,
+        // and leaves the reader usable for the next batch
+        for (int round = 0; round < 2; ++round) {
+            std::vector<nanocbf::FileRequest> requests(filenames.size());
+            for (size_t i = 0; i < filenames.size(); ++i) {
+                requests[i].filename = filenames[i];
+            }
+            CHECK(reader->read(requests.data(), requests.size()));
+            CHECK(wrongByteFiles(requests) == 0);
+        }
+        // Unless the kernel has no io_uring, the faults were injected
+        CHECK(g_faultMode == 0 || std::strcmp(reader->name(), "io_uring") != 0 || g_enterCalls >= 2);
+    }
+    g_faultMode = 0;
+}
+#endif
+
+static void testHeaderTemplate() {
+    nanocbf::HeaderTemplate pattern("# Start_angle ${angle:10} deg.\r\n# Frame ${frame:6}|${name:4}|${count:3}\r\n");
+    CHECK(pattern.getError().empty());
+    CHECK(pattern.slotCount() == 4);
+    CHECK(pattern.slot("frame") == 1);
+    CHECK(pattern.slot("missing") == -1);
+
+    // Every overload pads to the slot width; floats and doubles are formatted alike
+    int angle = pattern.slot("angle");
+    CHECK(pattern.set(angle, 12.5));
+    CHECK(pattern.text() == "# Start_angle 12.5000    deg.\r\n# Frame       |    |   \r\n");
+    CHECK(pattern.set(angle, 12.5f));
+    CHECK(pattern.text().compare(0, 28, "# Start_angle 12.5000    deg") == 0);
+    CHECK(pattern.set(angle, 0.25, 2));
+    CHECK(pattern.text().compare(0, 28, "# Start_angle 0.25       deg") == 0);
+    short frameNumber = -2;
+    CHECK(pattern.set(pattern.slot("frame"), frameNumber));
+    CHECK(pattern.set(pattern.slot("name"), std::string("ab")));
+    CHECK(pattern.set(pattern.slot("count"), 7u));
+    CHECK(pattern.text() == "# Start_angle 0.25       deg.\r\n# Frame -2    |ab  |7  \r\n");
+
+    // Values that do not fit leave the slot as it was
+    CHECK(!pattern.set(pattern.slot("count"), 1000));
+    CHECK(!pattern.set(pattern.slot("name"), std::string("toolong")));
+    CHECK(!pattern.set(angle, 1e30));
+    CHECK(!pattern.set(-1, 1));
+    CHECK(!pattern.set(4, 1));
+    CHECK(pattern.text() == "# Start_angle 0.25       deg.\r\n# Frame -2    |ab  |7  \r\n");
+
+    nanocbf::HeaderTemplate malformed;
+    CHECK(!malformed.compile("${angle:x}"));
+    CHECK(!malformed.getError().empty());
+
+    // A frame written with the template reads back with its text as header
+    nanocbf::CBFFrame frame = makeFrame(20, 10);
+    frame.headerTemplate = &pattern;
+    CHECK(frame.write("nanocbf_test_template.cbf"));
+    CHECK(pattern.set(pattern.slot("frame"), 2));
+    CHECK(frame.write("nanocbf_test_template2.cbf"));
+
+    nanocbf::CBFFrame readBack;
+    CHECK(readBack.read("nanocbf_test_template.cbf"));
+    CHECK(readBack.data == frame.data);
+    CHECK(readBack.header.find("# Frame -2    |ab  |7  ") != std::string::npos);
+    CHECK(readBack.read("nanocbf_test_template2.cbf"));
+    CHECK(readBack.header.find("# Frame 2     |ab  |7  ") != std::string::npos);
+}
+
+static void testReadHeader() {
+    nanocbf::CBFFrame frame;
+    CHECK(frame.readHeader(REFERENCE_FILE));
+    CHECK(frame.width == 500 && frame.height == 500);
+    CHECK(frame.binaryInfo.size == 250000);
+    CHECK(frame.data.empty());
+
+    // A header larger than the first chunk that readHeader reads
+    nanocbf::CBFFrame big = makeFrame(30, 20);
+    big.header = "# " + std::string(100000, 'x') + "\r\n";
+    CHECK(big.write("nanocbf_test_header.cbf"));
+    CHECK(frame.readHeader("nanocbf_test_header.cbf"));
+    CHECK(frame.width == 30 && frame.height == 20);
+
+    // No CBF text at all: given up on after a bounded read, not at the end
+    saveFile("nanocbf_test_header.cbf", std::string(3 << 20, '\0'));
+    CHECK(!frame.readHeader("nanocbf_test_header.cbf"));
+    CHECK(frame.getError().find("in the first") != std::string::npos);
+
+    // Broken text in front of the binary section fails at once
+    std::string contents = fileContents(REFERENCE_FILE);
+    saveFile("nanocbf_test_header.cbf", replaced(contents, "_array_data.data", "_array_data.xxxx") + std::string(3 << 20, '\0'));
+    CHECK(!frame.readHeader("nanocbf_test_header.cbf"));
+    CHECK(frame.getError() == "Could not find _array_data.data section");
+    CHECK(!frame.readHeader("nanocbf_test_missing.cbf"));
+}
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+
+static const Test TESTS[] = {
+    {"md5", testMD5},
+    {"integrity", testIntegrity},
+    {"element_types", testElementTypes},
+    {"geometry_decoder", testGeometryDecoder},
+    {"float_correction", testFloatCorrection},
+    {"region", testRegion},
+    {"bad_row_index", testBadRowIndex},
+    {"damaged_stream", testDamagedStream},
+    {"bad_mime_header", testBadMimeHeader},
+    {"io_backends", testIOBackends},
+    {"header_template", testHeaderTemplate},
+    {"read_header", testReadHeader},
+#ifdef NANOCBF_TEST_IO_FAULTS
+    {"io_uring_faults", testIOUringFaults},
+#endif
+};
+
+int main(int argc, char** argv) {
+    bool found = false;
+    for (size_t i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); ++i) {
+        if (argc > 1 && std::strcmp(argv[1], TESTS[i].name) != 0) {
+            continue;
+        }
+        found = true;
+        int before = g_failures;
+        TESTS[i].run();
+        std::cout << (g_failures == before ? "PASS " : "FAIL ") << TESTS[i].name << std::endl;
+    }
+    if (!found) {
+        std::cerr << "Unknown test: " << argv[1] << std::endl;
+        return 1;
+    }
+    return g_failures == 0 ? 0 : 1;
+}